@@ -0,0 +1,250 @@
+#include "geo.h"
+
+country countries[] = {
+{ "Andorra", "AD", 1.601554, 42.546245 },
+{ "United Arab Emirates", "AE", 53.847818, 23.424076 },
+{ "Afghanistan", "AF", 67.709953, 33.93911 },
+{ "Antigua and Barbuda", "AG", -61.796428, 17.060816 },
+{ "Anguilla", "AI", -63.068615, 18.220554 },
+{ "Albania", "AL", 20.168331, 41.153332 },
+{ "Armenia", "AM", 45.038189, 40.069099 },
+{ "Netherlands Antilles", "AN", -69.060087, 12.226079 },
+{ "Angola", "AO", 17.873887, -11.202692 },
+{ "Antarctica", "AQ", -0.071389, -75.250973 },
+{ "Argentina", "AR", -63.616672, -38.416097 },
+{ "American Samoa", "AS", -170.132217, -14.270972 },
+{ "Austria", "AT", 14.550072, 47.516231 },
+{ "Australia", "AU", 133.775136, -25.274398 },
+{ "Aruba", "AW", -69.968338, 12.52111 },
+{ "Azerbaijan", "AZ", 47.576927, 40.143105 },
+{ "Bosnia and Herzegovina", "BA", 17.679076, 43.915886 },
+{ "Barbados", "BB", -59.543198, 13.193887 },
+{ "Bangladesh", "BD", 90.356331, 23.684994 },
+{ "Belgium", "BE", 4.469936, 50.503887 },
+{ "Burkina Faso", "BF", -1.561593, 12.238333 },
+{ "Bulgaria", "BG", 25.48583, 42.733883 },
+{ "Bahrain", "BH", 50.637772, 25.930414 },
+{ "Burundi", "BI", 29.918886, -3.373056 },
+{ "Benin", "BJ", 2.315834, 9.30769 },
+{ "Bermuda", "BM", -64.75737, 32.321384 },
+{ "Brunei", "BN", 114.727669, 4.535277 },
+{ "Bolivia", "BO", -63.588653, -16.290154 },
+{ "Brazil", "BR", -51.92528, -14.235004 },
+{ "Bahamas", "BS", -77.39628, 25.03428 },
+{ "Bhutan", "BT", 90.433601, 27.514162 },
+{ "Bouvet Island", "BV", 3.413194, -54.423199 },
+{ "Botswana", "BW", 24.684866, -22.328474 },
+{ "Belarus", "BY", 27.953389, 53.709807 },
+{ "Belize", "BZ", -88.49765, 17.189877 },
+{ "Canada", "CA", -106.346771, 56.130366 },
+{ "Cocos [Keeling] Islands", "CC", 96.870956, -12.164165 },
+{ "Congo [DRC]", "CD", 21.758664, -4.038333 },
+{ "Central African Republic", "CF", 20.939444, 6.611111 },
+{ "Congo [Republic]", "CG", 15.827659, -0.228021 },
+{ "Switzerland", "CH", 8.227512, 46.818188 },
+{ "Côte d'Ivoire", "CI", -5.54708, 7.539989 },
+{ "Cook Islands", "CK", -159.777671, -21.236736 },
+{ "Chile", "CL", -71.542969, -35.675147 },
+{ "Cameroon", "CM", 12.354722, 7.369722 },
+{ "China", "CN", 104.195397, 35.86166 },
+{ "Colombia", "CO", -74.297333, 4.570868 },
+{ "Costa Rica", "CR", -83.753428, 9.748917 },
+{ "Cuba", "CU", -77.781167, 21.521757 },
+{ "Cape Verde", "CV", -24.013197, 16.002082 },
+{ "Christmas Island", "CX", 105.690449, -10.447525 },
+{ "Cyprus", "CY", 33.429859, 35.126413 },
+{ "Czech Republic", "CZ", 15.472962, 49.817492 },
+{ "Germany", "DE", 10.451526, 51.165691 },
+{ "Djibouti", "DJ", 42.590275, 11.825138 },
+{ "Denmark", "DK", 9.501785, 56.26392 },
+{ "Dominica", "DM", -61.370976, 15.414999 },
+{ "Dominican Republic", "DO", -70.162651, 18.735693 },
+{ "Algeria", "DZ", 1.659626, 28.033886 },
+{ "Ecuador", "EC", -78.183406, -1.831239 },
+{ "Estonia", "EE", 25.013607, 58.595272 },
+{ "Egypt", "EG", 30.802498, 26.820553 },
+{ "Western Sahara", "EH", -12.885834, 24.215527 },
+{ "Eritrea", "ER", 39.782334, 15.179384 },
+{ "Spain", "ES", -3.74922, 40.463667 },
+{ "Ethiopia", "ET", 40.489673, 9.145 },
+{ "Finland", "FI", 25.748151, 61.92411 },
+{ "Fiji", "FJ", 179.414413, -16.578193 },
+{ "Falkland Islands [Islas Malvinas]", "FK", -59.523613, -51.796253 },
+{ "Micronesia", "FM", 150.550812, 7.425554 },
+{ "Faroe Islands", "FO", -6.911806, 61.892635 },
+{ "France", "FR", 2.213749, 46.227638 },
+{ "Gabon", "GA", 11.609444, -0.803689 },
+{ "United Kingdom", "GB", -3.435973, 55.378051 },
+{ "Grenada", "GD", -61.604171, 12.262776 },
+{ "Georgia", "GE", 43.356892, 42.315407 },
+{ "French Guiana", "GF", -53.125782, 3.933889 },
+{ "Guernsey", "GG", -2.585278, 49.465691 },
+{ "Ghana", "GH", -1.023194, 7.946527 },
+{ "Gibraltar", "GI", -5.345374, 36.137741 },
+{ "Greenland", "GL", -42.604303, 71.706936 },
+{ "Gambia", "GM", -15.310139, 13.443182 },
+{ "Guinea", "GN", -9.696645, 9.945587 },
+{ "Guadeloupe", "GP", -62.067641, 16.995971 },
+{ "Equatorial Guinea", "GQ", 10.267895, 1.650801 },
+{ "Greece", "GR", 21.824312, 39.074208 },
+{ "South Georgia and the South Sandwich Islands", "GS", -36.587909, -54.429579 },
+{ "Guatemala", "GT", -90.230759, 15.783471 },
+{ "Guam", "GU", 144.793731, 13.444304 },
+{ "Guinea-Bissau", "GW", -15.180413, 11.803749 },
+{ "Guyana", "GY", -58.93018, 4.860416 },
+{ "Gaza Strip", "GZ", 34.308825, 31.354676 },
+{ "Hong Kong", "HK", 114.109497, 22.396428 },
+{ "Heard Island and McDonald Islands", "HM", 73.504158, -53.08181 },
+{ "Honduras", "HN", -86.241905, 15.199999 },
+{ "Croatia", "HR", 15.2, 45.1 },
+{ "Haiti", "HT", -72.285215, 18.971187 },
+{ "Hungary", "HU", 19.503304, 47.162494 },
+{ "Indonesia", "ID", 113.921327, -0.789275 },
+{ "Ireland", "IE", -8.24389, 53.41291 },
+{ "Israel", "IL", 34.851612, 31.046051 },
+{ "Isle of Man", "IM", -4.548056, 54.236107 },
+{ "India", "IN", 78.96288, 20.593684 },
+{ "British Indian Ocean Territory", "IO", 71.876519, -6.343194 },
+{ "Iraq", "IQ", 43.679291, 33.223191 },
+{ "Iran", "IR", 53.688046, 32.427908 },
+{ "Iceland", "IS", -19.020835, 64.963051 },
+{ "Italy", "IT", 12.56738, 41.87194 },
+{ "Jersey", "JE", -2.13125, 49.214439 },
+{ "Jamaica", "JM", -77.297508, 18.109581 },
+{ "Jordan", "JO", 36.238414, 30.585164 },
+{ "Japan", "JP", 138.252924, 36.204824 },
+{ "Kenya", "KE", 37.906193, -0.023559 },
+{ "Kyrgyzstan", "KG", 74.766098, 41.20438 },
+{ "Cambodia", "KH", 104.990963, 12.565679 },
+{ "Kiribati", "KI", -168.734039, -3.370417 },
+{ "Comoros", "KM", 43.872219, -11.875001 },
+{ "Saint Kitts and Nevis", "KN", -62.782998, 17.357822 },
+{ "North Korea", "KP", 127.510093, 40.339852 },
+{ "South Korea", "KR", 127.766922, 35.907757 },
+{ "Kuwait", "KW", 47.481766, 29.31166 },
+{ "Cayman Islands", "KY", -80.566956, 19.513469 },
+{ "Kazakhstan", "KZ", 66.923684, 48.019573 },
+{ "Laos", "LA", 102.495496, 19.85627 },
+{ "Lebanon", "LB", 35.862285, 33.854721 },
+{ "Saint Lucia", "LC", -60.978893, 13.909444 },
+{ "Liechtenstein", "LI", 9.555373, 47.166 },
+{ "Sri Lanka", "LK", 80.771797, 7.873054 },
+{ "Liberia", "LR", -9.429499, 6.428055 },
+{ "Lesotho", "LS", 28.233608, -29.609988 },
+{ "Lithuania", "LT", 23.881275, 55.169438 },
+{ "Luxembourg", "LU", 6.129583, 49.815273 },
+{ "Latvia", "LV", 24.603189, 56.879635 },
+{ "Libya", "LY", 17.228331, 26.3351 },
+{ "Morocco", "MA", -7.09262, 31.791702 },
+{ "Monaco", "MC", 7.412841, 43.750298 },
+{ "Moldova", "MD", 28.369885, 47.411631 },
+{ "Montenegro", "ME", 19.37439, 42.708678 },
+{ "Madagascar", "MG", 46.869107, -18.766947 },
+{ "Marshall Islands", "MH", 171.184478, 7.131474 },
+{ "Macedonia [FYROM]", "MK", 21.745275, 41.608635 },
+{ "Mali", "ML", -3.996166, 17.570692 },
+{ "Myanmar [Burma]", "MM", 95.956223, 21.913965 },
+{ "Mongolia", "MN", 103.846656, 46.862496 },
+{ "Macau", "MO", 113.543873, 22.198745 },
+{ "Northern Mariana Islands", "MP", 145.38469, 17.33083 },
+{ "Martinique", "MQ", -61.024174, 14.641528 },
+{ "Mauritania", "MR", -10.940835, 21.00789 },
+{ "Montserrat", "MS", -62.187366, 16.742498 },
+{ "Malta", "MT", 14.375416, 35.937496 },
+{ "Mauritius", "MU", 57.552152, -20.348404 },
+{ "Maldives", "MV", 73.22068, 3.202778 },
+{ "Malawi", "MW", 34.301525, -13.254308 },
+{ "Mexico", "MX", -102.552784, 23.634501 },
+{ "Malaysia", "MY", 101.975766, 4.210484 },
+{ "Mozambique", "MZ", 35.529562, -18.665695 },
+{ "Namibia", "NA", 18.49041, -22.95764 },
+{ "New Caledonia", "NC", 165.618042, -20.904305 },
+{ "Niger", "NE", 8.081666, 17.607789 },
+{ "Norfolk Island", "NF", 167.954712, -29.040835 },
+{ "Nigeria", "NG", 8.675277, 9.081999 },
+{ "Nicaragua", "NI", -85.207229, 12.865416 },
+{ "Netherlands", "NL", 5.291266, 52.132633 },
+{ "Norway", "NO", 8.468946, 60.472024 },
+{ "Nepal", "NP", 84.124008, 28.394857 },
+{ "Nauru", "NR", 166.931503, -0.522778 },
+{ "Niue", "NU", -169.867233, -19.054445 },
+{ "New Zealand", "NZ", 174.885971, -40.900557 },
+{ "Oman", "OM", 55.923255, 21.512583 },
+{ "Panama", "PA", -80.782127, 8.537981 },
+{ "Peru", "PE", -75.015152, -9.189967 },
+{ "French Polynesia", "PF", -149.406843, -17.679742 },
+{ "Papua New Guinea", "PG", 143.95555, -6.314993 },
+{ "Philippines", "PH", 121.774017, 12.879721 },
+{ "Pakistan", "PK", 69.345116, 30.375321 },
+{ "Poland", "PL", 19.145136, 51.919438 },
+{ "Saint Pierre and Miquelon", "PM", -56.27111, 46.941936 },
+{ "Pitcairn Islands", "PN", -127.439308, -24.703615 },
+{ "Puerto Rico", "PR", -66.590149, 18.220833 },
+{ "Palestinian Territories", "PS", 35.233154, 31.952162 },
+{ "Portugal", "PT", -8.224454, 39.399872 },
+{ "Palau", "PW", 134.58252, 7.51498 },
+{ "Paraguay", "PY", -58.443832, -23.442503 },
+{ "Qatar", "QA", 51.183884, 25.354826 },
+{ "Réunion", "RE", 55.536384, -21.115141 },
+{ "Romania", "RO", 24.96676, 45.943161 },
+{ "Serbia", "RS", 21.005859, 44.016521 },
+{ "Russia", "RU", 105.318756, 61.52401 },
+{ "Rwanda", "RW", 29.873888, -1.940278 },
+{ "Saudi Arabia", "SA", 45.079162, 23.885942 },
+{ "Solomon Islands", "SB", 160.156194, -9.64571 },
+{ "Seychelles", "SC", 55.491977, -4.679574 },
+{ "Sudan", "SD", 30.217636, 12.862807 },
+{ "Sweden", "SE", 18.643501, 60.128161 },
+{ "Singapore", "SG", 103.819836, 1.352083 },
+{ "Saint Helena", "SH", -10.030696, -24.143474 },
+{ "Slovenia", "SI", 14.995463, 46.151241 },
+{ "Svalbard and Jan Mayen", "SJ", 23.670272, 77.553604 },
+{ "Slovakia", "SK", 19.699024, 48.669026 },
+{ "Sierra Leone", "SL", -11.779889, 8.460555 },
+{ "San Marino", "SM", 12.457777, 43.94236 },
+{ "Senegal", "SN", -14.452362, 14.497401 },
+{ "Somalia", "SO", 46.199616, 5.152149 },
+{ "Suriname", "SR", -56.027783, 3.919305 },
+{ "São Tomé and Príncipe", "ST", 6.613081, 0.18636 },
+{ "El Salvador", "SV", -88.89653, 13.794185 },
+{ "Syria", "SY", 38.996815, 34.802075 },
+{ "Swaziland", "SZ", 31.465866, -26.522503 },
+{ "Turks and Caicos Islands", "TC", -71.797928, 21.694025 },
+{ "Chad", "TD", 18.732207, 15.454166 },
+{ "French Southern Territories", "TF", 69.348557, -49.280366 },
+{ "Togo", "TG", 0.824782, 8.619543 },
+{ "Thailand", "TH", 100.992541, 15.870032 },
+{ "Tajikistan", "TJ", 71.276093, 38.861034 },
+{ "Tokelau", "TK", -171.855881, -8.967363 },
+{ "Timor-Leste", "TL", 125.727539, -8.874217 },
+{ "Turkmenistan", "TM", 59.556278, 38.969719 },
+{ "Tunisia", "TN", 9.537499, 33.886917 },
+{ "Tonga", "TO", -175.198242, -21.178986 },
+{ "Turkey", "TR", 35.243322, 38.963745 },
+{ "Trinidad and Tobago", "TT", -61.222503, 10.691803 },
+{ "Tuvalu", "TV", 177.64933, -7.109535 },
+{ "Taiwan", "TW", 120.960515, 23.69781 },
+{ "Tanzania", "TZ", 34.888822, -6.369028 },
+{ "Ukraine", "UA", 31.16558, 48.379433 },
+{ "Uganda", "UG", 32.290275, 1.373333 },
+{ "United States", "US", -95.712891, 37.09024 },
+{ "Uruguay", "UY", -55.765835, -32.522779 },
+{ "Uzbekistan", "UZ", 64.585262, 41.377491 },
+{ "Vatican City", "VA", 12.453389, 41.902916 },
+{ "Saint Vincent and the Grenadines", "VC", -61.287228, 12.984305 },
+{ "Venezuela", "VE", -66.58973, 6.42375 },
+{ "British Virgin Islands", "VG", -64.639968, 18.420695 },
+{ "U.S. Virgin Islands", "VI", -64.896335, 18.335765 },
+{ "Vietnam", "VN", 108.277199, 14.058324 },
+{ "Vanuatu", "VU", 166.959158, -15.376706 },
+{ "Wallis and Futuna", "WF", -177.156097, -13.768752 },
+{ "Samoa", "WS", -172.104629, -13.759029 },
+{ "Kosovo", "XK", 20.902977, 42.602636 },
+{ "Yemen", "YE", 48.516388, 15.552727 },
+{ "Mayotte", "YT", 45.166244, -12.8275 },
+{ "South Africa", "ZA", 22.937506, -30.559482 },
+{ "Zambia", "ZM", 27.849332, -13.133897 },
+{ "Zimbabwe", "ZW", 29.154857, -19.015438 },
+};
+
+size_t nr_countries=244;
@@ -23,42 +23,22 @@ typedef int bool;
  *
  */
 typedef struct ElsetRec {
-    int whichconst;
-    char satid[6];
-    int epochyr;
-    int epochtynumrev;
-    int error;
+    // The fields that sgp4() uses for every satellite come first, so that
+    // propagating a near-earth satellite touches as few cache lines as possible
+    char method;
     char operationmode;
-    char init;
-    char method;    
-    double a;
-    double altp;
-    double alta;
-    double epochdays;
-    double jdsatepoch;
-    double jdsatepochF;
-    double nddot;
-    double ndot;
+    int isimp;
+    int error;
+
+    double t;
     double bstar;
-    double rcse;
     double inclo;
     double nodeo;
     double ecco;
     double argpo;
     double mo;
-    double no_kozai;
-    
-    // sgp4fix add new variables from tle
-    char classification;
-    char intldesg[12];
-    int ephtype;
-    long elnum;
-    long revnum;
-    
-    // sgp4fix add unkozai'd variable
     double no_unkozai;
-    
-    // sgp4fix add singly averaged variables
+
     double am;
     double em;
     double im;
@@ -66,34 +46,24 @@ typedef struct ElsetRec {
     double om;
     double mm;
     double nm;
-    double t;
-    
-    // sgp4fix add constant parameters to eliminate mutliple calls during execution
-    double tumin;
-    double mu;
-    double radiusearthkm;
-    double xke; 
-    double j2;
-    double j3;
-    double j4;
-    double j3oj2;
-    
-    //       Additional elements to capture relevant TLE and object information:       
-    long dia_mm; // RSO dia in mm
-    double period_sec; // Period in seconds
-    char active; // "Active S/C" flag (0=n, 1=y) 
-    char not_orbital; // "Orbiting S/C" flag (0=n, 1=y)  
-    double rcs_m2; // "RCS (m^2)" storage  
 
-    // temporary variables because the original authors call the same method with different variables
+    double argpm;
+    double inclm;
+    double nodem;
     double ep;
     double inclp;
     double nodep;
     double argpp;
     double mp;
+    double sinim;
+    double cosim;
+    double emsq;
 
+    double xke;
+    double j2;
+    double j3oj2;
+    double radiusearthkm;
 
-    int isimp;
     double aycof;
     double con41;
     double cc1;
@@ -119,6 +89,42 @@ typedef struct ElsetRec {
     double xmcof;
     double nodecf;
 
+    int whichconst;
+    char satid[6];
+    int epochyr;
+    int epochtynumrev;
+    char init;
+    double a;
+    double altp;
+    double alta;
+    double epochdays;
+    double jdsatepoch;
+    double jdsatepochF;
+    double nddot;
+    double ndot;
+    double rcse;
+    double no_kozai;
+    
+    // sgp4fix add new variables from tle
+    char classification;
+    char intldesg[12];
+    int ephtype;
+    long elnum;
+    long revnum;
+    
+    // sgp4fix add constant parameters to eliminate mutliple calls during execution
+    double tumin;
+    double mu;
+    double j3;
+    double j4;
+    
+    //       Additional elements to capture relevant TLE and object information:       
+    long dia_mm; // RSO dia in mm
+    double period_sec; // Period in seconds
+    char active; // "Active S/C" flag (0=n, 1=y) 
+    char not_orbital; // "Orbiting S/C" flag (0=n, 1=y)  
+    double rcs_m2; // "RCS (m^2)" storage  
+
     // deep space
     int irez;
     double d2201;
@@ -178,12 +184,9 @@ typedef struct ElsetRec {
     double xni;
     double snodm;
     double cnodm;
-    double sinim;
-    double cosim;
     double sinomm;
     double cosomm;
     double day;
-    double emsq;
     double gam;
     double rtemsq; 
     double s1;
@@ -224,9 +227,6 @@ typedef struct ElsetRec {
     double z31;
     double z32;
     double z33;
-    double argpm;
-    double inclm;
-    double nodem;
     double dndt;
     double eccsq;
         
@@ -12,16 +12,16 @@ double gd(char *str, int ind1, int ind2);
 // parse the double with implied decimal
 double gdi(char *str, int ind1, int ind2);
 
-void setValsToRec(TLE *tle, ElsetRec *rec);
+void setValsToRec(TLEInfo *info, ElsetRec *rec);
  
-void parseLines(TLE *tle, char *line1, char *line2)
+void parseLines(TLE *tle, TLEInfo *info, char *line1, char *line2)
 {
     tle->rec.whichconst=wgs72;
     // copy the lines
-    strncpy(tle->line1,line1,69);
-    strncpy(tle->line2,line2,69);
-    tle->line1[69]=0;
-    tle->line2[69]=0;
+    strncpy(info->line1,line1,69);
+    strncpy(info->line2,line2,69);
+    info->line1[69]=0;
+    info->line2[69]=0;
 
            //          1         2         3         4         5         6
                //0123456789012345678901234567890123456789012345678901234567890123456789
@@ -29,64 +29,64 @@ void parseLines(TLE *tle, char *line1, char *line2)
     //line2="2 00005  34.2682 348.7242 1859667 331.7664  19.3264 10.82419157413667";
 
     // intlid
-    strncpy(tle->intlid,&line1[9],8);
+    strncpy(info->intlid,&line1[9],8);
 
     tle->rec.classification=line1[7];
 
     //tle->objectNum = (int)gd(line1,2,7);
-    strncpy(tle->objectID,&line1[2],5);
-    tle->objectID[5]=0;
+    strncpy(info->objectID,&line1[2],5);
+    info->objectID[5]=0;
 
-    tle->ndot = gdi(line1,35,44);
-    if(line1[33]=='-') tle->ndot *= -1.0;
+    info->ndot = gdi(line1,35,44);
+    if(line1[33]=='-') info->ndot *= -1.0;
 
-    tle->nddot = gdi(line1,45,50);
-    if(line1[44]=='-') tle->nddot *= -1.0;
-    tle->nddot *= pow(10.0, gd(line1,50,52));
+    info->nddot = gdi(line1,45,50);
+    if(line1[44]=='-') info->nddot *= -1.0;
+    info->nddot *= pow(10.0, gd(line1,50,52));
 
-    tle->bstar = gdi(line1,54,59);
-    if(line1[53]=='-') tle->bstar *= -1.0;
-    tle->bstar *= pow(10.0, gd(line1,59,61));
+    info->bstar = gdi(line1,54,59);
+    if(line1[53]=='-') info->bstar *= -1.0;
+    info->bstar *= pow(10.0, gd(line1,59,61));
         
-    tle->elnum = (int)gd(line1,64,68);
+    info->elnum = (int)gd(line1,64,68);
 
-    tle->incDeg = gd(line2,8,16);
-    tle->raanDeg = gd(line2,17,25);
-    tle->ecc = gdi(line2,26,33);
-    tle->argpDeg = gd(line2,34,42);
-    tle->maDeg = gd(line2,43,51);
-    tle->n = gd(line2,52,63);
-    tle->revnum = (int)gd(line2,63,68);
+    info->incDeg = gd(line2,8,16);
+    info->raanDeg = gd(line2,17,25);
+    info->ecc = gdi(line2,26,33);
+    info->argpDeg = gd(line2,34,42);
+    info->maDeg = gd(line2,43,51);
+    info->n = gd(line2,52,63);
+    info->revnum = (int)gd(line2,63,68);
 
     tle->sgp4Error = 0;
 
     tle->epoch = parseEpoch(&tle->rec,&line1[18]);
 
-    setValsToRec(tle, &tle->rec);
+    setValsToRec(info, &tle->rec);
 }
 
-void fromTLEData(TLE *tle, tledata *td) {
+void fromTLEData(TLE *tle, TLEInfo *info, tledata *td) {
     tle->rec.whichconst=wgs72;
-    tle->line1[0] = 0;
-    tle->line2[0] = 0;
-    snprintf(tle->intlid, 11, "%02d%03d%-3s",
+    info->line1[0] = 0;
+    info->line2[0] = 0;
+    snprintf(info->intlid, 11, "%02d%03d%-3s",
              td->launch_year, td->launch_number, td->launch_piece);
     tle->rec.classification = td->classification;
-    snprintf(tle->objectID, 5, "%05d", td->cat_number);
-    tle->ndot = td->ballistic_coeff;
-    tle->nddot = td->second_deriv_mean_motion;
-    tle->bstar = td->bstar;
-    tle->elnum = td->element_set_number;
-    tle->incDeg = td->inclination;
-    tle->raanDeg = td->raan;
-    tle->ecc = td->eccentricity;
-    tle->argpDeg = td->arg_of_perigee;
-    tle->maDeg = td->mean_anomaly;
-    tle->n = td->mean_motion;
-    tle->revnum = td->revolution_number;
+    snprintf(info->objectID, 5, "%05d", td->cat_number);
+    info->ndot = td->ballistic_coeff;
+    info->nddot = td->second_deriv_mean_motion;
+    info->bstar = td->bstar;
+    info->elnum = td->element_set_number;
+    info->incDeg = td->inclination;
+    info->raanDeg = td->raan;
+    info->ecc = td->eccentricity;
+    info->argpDeg = td->arg_of_perigee;
+    info->maDeg = td->mean_anomaly;
+    info->n = td->mean_motion;
+    info->revnum = td->revolution_number;
     tle->sgp4Error = 0;
     tle->epoch = td->epoch * 1000;
-    setValsToRec(tle, &tle->rec);
+    setValsToRec(info, &tle->rec);
     
     
 }
@@ -144,7 +144,7 @@ long parseEpoch(ElsetRec *rec, char *str)
 
     tmp2[0]='0';
     strncpy(&tmp2[1],&tmp[5],9);
-    tmp2[11]=0;
+    tmp2[10]=0;
     double dfrac = strtod(tmp2,NULL);
     rec->epochdays = doy;
     rec->epochdays += dfrac;
@@ -203,6 +203,21 @@ void getRV(TLE *tle, double minutesAfterEpoch, double r[3], double v[3])
     tle->sgp4Error = tle->rec.error;
 }
 
+const char *getSGP4ErrorMessage(int error)
+{
+    switch(error)
+    {
+        case 0: return "no error";
+        case 1: return "mean eccentricity out of range";
+        case 2: return "mean motion less than zero";
+        case 3: return "perturbed eccentricity out of range";
+        case 4: return "semi-latus rectum less than zero";
+        case 5: return "epoch elements are sub-orbital";
+        case 6: return "satellite has decayed";
+        default: return "unknown error";
+    }
+}
+
 double gd(char *str, int ind1, int ind2)
 {
     double num = 0;
@@ -228,23 +243,23 @@ double gdi(char *str, int ind1, int ind2)
     return num;
 }
 
-void setValsToRec(TLE *tle, ElsetRec *rec)
+void setValsToRec(TLEInfo *info, ElsetRec *rec)
 {
     double xpdotp = 1440.0 / (2.0 * pi);  // 229.1831180523293
 
-    rec->elnum = tle->elnum;
-    rec->revnum = tle->revnum;
-    strncpy(rec->satid,tle->objectID,5);
+    rec->elnum = info->elnum;
+    rec->revnum = info->revnum;
+    strncpy(rec->satid,info->objectID,5);
     //rec->satnum = tle->objectNum;
-    rec->bstar = tle->bstar;
-    rec->inclo = tle->incDeg*deg2rad;
-    rec->nodeo = tle->raanDeg*deg2rad;
-    rec->argpo = tle->argpDeg*deg2rad;
-    rec->mo = tle->maDeg*deg2rad;
-    rec->ecco = tle->ecc;
-    rec->no_kozai = tle->n/xpdotp;
-    rec->ndot = tle->ndot / (xpdotp*1440.0);
-    rec->nddot = tle->nddot / (xpdotp*1440.0*1440.0);
+    rec->bstar = info->bstar;
+    rec->inclo = info->incDeg*deg2rad;
+    rec->nodeo = info->raanDeg*deg2rad;
+    rec->argpo = info->argpDeg*deg2rad;
+    rec->mo = info->maDeg*deg2rad;
+    rec->ecco = info->ecc;
+    rec->no_kozai = info->n/xpdotp;
+    rec->ndot = info->ndot / (xpdotp*1440.0);
+    rec->nddot = info->nddot / (xpdotp*1440.0*1440.0);
         
     sgp4init('a', rec);
 }
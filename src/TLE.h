@@ -4,13 +4,20 @@
 #include "SGP4.h"
 #include "tledata.h"
 
+// The part of a TLE that is needed for propagation. The elements as they
+// appear in the TLE are kept in a separate TLEInfo, so arrays of TLEs stay
+// compact when many satellites are propagated
 typedef struct TLE {
+    long epoch;
+    int sgp4Error;
     ElsetRec rec;
+} TLE;
+
+typedef struct TLEInfo {
     char line1[70];
     char line2[70];
     char intlid[12];
     char objectID[6];
-    long epoch;
     double ndot;
     double nddot;
     double bstar;
@@ -22,11 +29,10 @@ typedef struct TLE {
     double maDeg;
     double n;
     int revnum;
-    int sgp4Error;
-} TLE;
+} TLEInfo;
 
-void parseLines(TLE *tle, char *line1, char *line2);
-void fromTLEData(TLE *tle, tledata *td);
+void parseLines(TLE *tle, TLEInfo *info, char *line1, char *line2);
+void fromTLEData(TLE *tle, TLEInfo *info, tledata *td);
 
 long parseEpoch(ElsetRec *rec, char *str);
 
@@ -34,4 +40,7 @@ void getRVForDate(TLE *tle, long millisSince1970, double r[3], double v[3]);
 
 void getRV(TLE *tle, double minutesAfterEpoch, double r[3], double v[3]);
 
+// describes the error that sgp4 left in sgp4Error
+const char *getSGP4ErrorMessage(int error);
+
 #endif
@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "arena.h"
+
+#define MIN_BLOCK_SIZE (64 * 1024)
+/* Blocks double in size up to this, so the number of blocks stays small */
+#define MAX_BLOCK_SIZE (64 * 1024 * 1024)
+
+#define ALIGNMENT (_Alignof(max_align_t))
+
+struct arena_block {
+    arena_block *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+static size_t align(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+static void *allocate(arena *a, size_t size, size_t alignment) {
+    arena_block *block = a->blocks;
+    if(block) block->used = align(block->used, alignment);
+    if(!block || block->used > block->size || block->size - block->used < size) {
+        size_t block_size = a->next_size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : a->next_size;
+        while(block_size < size) block_size *= 2;
+        if(!(block = malloc(sizeof(arena_block) + block_size))) return NULL;
+        block->next = a->blocks;
+        block->size = block_size;
+        block->used = 0;
+        a->blocks = block;
+        a->next_size = block_size < MAX_BLOCK_SIZE ? block_size * 2 : block_size;
+    }
+    void *result = (char *)block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+void *arena_alloc(arena *a, size_t size) {
+    return allocate(a, size, ALIGNMENT);
+}
+
+char *arena_strdup(arena *a, const char *s) {
+    size_t len = strlen(s) + 1;
+    /* Strings need no alignment, so they are packed */
+    char *result = allocate(a, len, 1);
+    if(result) memcpy(result, s, len);
+    return result;
+}
+
+void arena_free(arena *a) {
+    while(a->blocks) {
+        arena_block *next = a->blocks->next;
+        free(a->blocks);
+        a->blocks = next;
+    }
+    a->next_size = 0;
+}
@@ -0,0 +1,26 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * An arena hands out memory from a few large blocks, and releases all of it
+ * at once in arena_free. Individual allocations cannot be freed. A zeroed
+ * arena is empty and ready for use.
+ */
+
+typedef struct arena_block arena_block;
+
+typedef struct {
+    arena_block *blocks;  /* The block that is currently being filled, first */
+    size_t next_size;     /* The size of the next block */
+} arena;
+
+/* Returns NULL when out of memory. The result is suitably aligned for any type */
+void *arena_alloc(arena *a, size_t size);
+
+char *arena_strdup(arena *a, const char *s);
+
+void arena_free(arena *a);
+
+#endif
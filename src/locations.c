@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "locations.h"
+#include "opt_util.h"
+
+int add_location(location_list *list, const char *name, double lat, double lon) {
+    if(list->count == list->size) {
+        size_t size = list->size ? list->size * 2 : 16;
+        location *locations = realloc(list->locations, size * sizeof(location));
+        if(!locations) return -1;
+        list->locations = locations;
+        list->size = size;
+    }
+    location *l = &list->locations[list->count];
+    if(!(l->name = strdup(name))) return -1;
+    l->lat = lat;
+    l->lon = lon;
+    list->count++;
+    return 0;
+}
+
+int read_locations(location_list *list, const char *filename) {
+    FILE *in = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
+    if(!in) return -1;
+    char *line = NULL;
+    size_t line_size = 0;
+    int result = 0;
+    while(!result && getline(&line, &line_size, in) >= 0) {
+        line[strcspn(line, "\r\n")] = 0;
+        char *lat_lon = line + strspn(line, " \t");
+        if(!*lat_lon || *lat_lon == '#') continue;
+        char *name = lat_lon + strcspn(lat_lon, " \t");
+        if(*name) *name++ = 0;
+        name += strspn(name, " \t");
+        double lat, lon;
+        if(arg_as_lon_lat(lat_lon, &lon, &lat)) result = -1;
+        else result = add_location(list, *name ? name : lat_lon, lat, lon);
+    }
+    free(line);
+    if(in != stdin) fclose(in);
+    return result;
+}
+
+void free_locations(location_list *list) {
+    for(size_t l=0; l<list->count; l++) free(list->locations[l].name);
+    free(list->locations);
+    list->locations = NULL;
+    list->count = list->size = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef LOCATIONS_H
+#define LOCATIONS_H
+
+#include <stddef.h>
+
+/*
+ * A list of named locations on the ground, given on the command line or read
+ * from a file with a location formatted as LAT,LON on every line, optionally
+ * followed by whitespace and a name. Empty lines and lines starting with #
+ * are skipped. A location without a name is named after its LAT,LON.
+ */
+typedef struct {
+    char *name;
+    double lat, lon;
+} location;
+
+typedef struct {
+    location *locations;
+    size_t count, size;
+} location_list;
+
+/* Returns non-zero when out of memory */
+int add_location(location_list *list, const char *name, double lat, double lon);
+
+/* Reads from stdin when filename is -. Returns non-zero when the file can not
+   be read or contains an invalid location */
+int read_locations(location_list *list, const char *filename);
+
+void free_locations(location_list *list);
+
+#endif
@@ -30,24 +30,67 @@ static void lla_to_ecef(double lon_deg, double lat_deg, double alt, double ecef[
 
 
 
+/* Rotational axis of the earth pointing north, needed in various places */
+static const double rot_axis[3] = { 0.0, 0.0, 1.0 };
+
+static void rotate_observer_frame(observer_frame *frame, long when) {
+    frame->when = when;
+    earth_rotation(when / 1000.0, &frame->cos_rotation, &frame->sin_rotation);
+    ecef_to_eci_rotated(frame->obs_ecef, frame->cos_rotation, frame->sin_rotation, frame->obs_eci);
+
+    /* The azimuth is calculated in the plane tangent to the earth surface at the
+       observer's location. To do this we need vectors in that plane pointing
+       east and north. The east vector is perpendicular to both obs_eci and to the
+       earth rotational axis, so we can get it using the cross product */
+    double down[3], east[3], north[3];
+    vec3_norm(frame->obs_eci, frame->obs_eci_norm);
+    vec3_scalar_mult(frame->obs_eci_norm, -1.0, down);
+    cross_product(down, rot_axis, east);
+    vec3_norm(east, frame->east_norm);
+    /* Now the vector pointing north is the cross product of obs_eci and east */
+    cross_product(east, down, north);
+    vec3_norm(north, frame->north_norm);
+}
+
+void set_observer_frame(const observer *obs, observer_frame *frame, long when) {
+    /* We have the observer's location in lon/lat/alt, convert this first
+       to ECEF then to ECI */
+    lla_to_ecef(obs->lon, obs->lat, obs->alt, frame->obs_ecef);
+    rotate_observer_frame(frame, when);
+}
+
+void advance_observer_frame(const observer_frame *previous, observer_frame *frame, long when) {
+    if(frame != previous) vec3_copy(frame->obs_ecef, previous->obs_ecef);
+    rotate_observer_frame(frame, when);
+}
+
 void observe(observer *obs, observation *o, TLE *tle, time_t when) {
-    /* Rotational axis of the earth pointing north, needed in various places */
-    double rot_axis[3] = { 0.0, 0.0, 1.0 };
+    observer_frame frame;
+    set_observer_frame(obs, &frame, when * 1000L);
+    observe_in_frame(&frame, o, tle);
+}
 
+double elevation_in_frame(const observer_frame *frame, const double eci[3]) {
+    double dir[3], dir_norm[3];
+    vec3_sub(eci, frame->obs_eci, dir);
+    vec3_norm(dir, dir_norm);
+    return rad_to_deg(asin(dot_product(dir_norm, frame->obs_eci_norm)));
+}
+
+void observe_in_frame(const observer_frame *frame, observation *o, TLE *tle) {
     /* Get the location of the satellite in ECI. This also gives us the satellite's 
        velocity */
     double sat_eci[3], sat_velocity_eci[3];
-    getRVForDate(tle, when * 1000, sat_eci, sat_velocity_eci);
+    getRVForDate(tle, frame->when, sat_eci, sat_velocity_eci);
+    observe_position_in_frame(frame, o, sat_eci, sat_velocity_eci);
+}
 
-    /* Now first populate all the position-related fields */
-    memcpy(o->sat_eci, sat_eci, sizeof sat_eci);
+void observe_position_in_frame(const observer_frame *frame, observation *o,
+                               const double sat_eci[3], const double sat_velocity_eci[3]) {
+    const double *obs_eci = frame->obs_eci;
 
-    /* We have the observer's location in lon/lat/alt, convert this first
-       to ECEF then to ECI */
-    double obs_ecef[3];
-    lla_to_ecef(obs->lon, obs->lat, obs->alt, obs_ecef);
-    double obs_eci[3];
-    ecef_to_eci(obs_ecef, (double)when, obs_eci);
+    /* Now first populate all the position-related fields */
+    memcpy(o->sat_eci, sat_eci, sizeof o->sat_eci);
 
     /* Calculate dir, the vector pointing from the observer to the satellite, and
        its length, range */
@@ -67,7 +110,7 @@ void observe(observer *obs, observation *o, TLE *tle, time_t when) {
 
     /* Use the dot-product of sat_eci and obs_eci to calculate phi (see calc1.png) */
     double dotp = dot_product(obs_eci, sat_eci);
-    double cos_phi = dotp / (vec3_len(sat_eci) * vec3_len(obs_eci));
+    double cos_phi = dotp / (vec3_len(sat_eci) * robs);
     double phi = acos(cos_phi);
 
     /* Now we have two angles of the triangle - the third angle is the elevation + 90 degrees */
@@ -76,12 +119,19 @@ void observe(observer *obs, observation *o, TLE *tle, time_t when) {
     o->range = range;
     o->elevation = rad_to_deg(elevation);
 
+    /* The range rate is the velocity of the satellite relative to the observer,
+       who moves along with the rotation of the earth, in the direction of dir */
+    double obs_velocity_eci[3] = { -WGS84_OMEGA * obs_eci[1], WGS84_OMEGA * obs_eci[0], 0 };
+    double relative_velocity[3];
+    vec3_sub(sat_velocity_eci, obs_velocity_eci, relative_velocity);
+    o->range_rate = dot_product(dir, relative_velocity) / range;
+
     /* Next order of business is to calculate the azimuth. To do this we first
        decompose the dir vector in a component along obs_eci and a component perpendicular
        to that. The perpendicular component will be in the plane tangent to 
        the earth surface and touching the earth at the observer's location. */
-    double obs_eci_norm[3], dir_norm[3];
-    vec3_norm(obs_eci, obs_eci_norm);
+    const double *obs_eci_norm = frame->obs_eci_norm;
+    double dir_norm[3];
     vec3_norm(dir, dir_norm);
     double dir_parallel[3], dir_parallel_norm[3]; /* This will the component of dir parallel to obs_eci */
     vec3_scalar_mult(obs_eci_norm, dot_product(dir, obs_eci_norm), dir_parallel);
@@ -92,24 +142,11 @@ void observe(observer *obs, observation *o, TLE *tle, time_t when) {
     vec3_norm(dir_perp, dir_perp_norm);
 
     /* To complete the azimuth calculation we need a vector in the same tangential plane, but
-       pointing north. The angle between the two vectors will be the azimuth. To calculate this
-       vector, we first compute a vector pointing east from the observer. This vector is 
-       perpendicular to both obs_eci and to the earth rotational axis, so we can get it
-       using the cross product */
-    double down[3], east[3];
-    vec3_scalar_mult(obs_eci_norm, -1.0, down);
-    cross_product(down, rot_axis, east);
-    double east_norm[3];
-    vec3_norm(east, east_norm);
-    /* Now the vector pointing north is the cross product of obs_eci and east */
-    double north[3], north_norm[3];
-    cross_product(east, down, north);
-    vec3_norm(north, north_norm);
-    
-    /* Since just the angle with the 'north' vector only gives as partial information (an
+       pointing north, which is part of the frame. The angle between the two vectors will be
+       the azimuth. Since just the angle with the 'north' vector only gives as partial information (an
        angle 0..PI), we'll look at the angle with the 'east' vector as well */
-    double cos_az_north = dot_product(north_norm, dir_perp_norm);
-    double cos_az_east = dot_product(east_norm, dir_perp_norm);
+    double cos_az_north = dot_product(frame->north_norm, dir_perp_norm);
+    double cos_az_east = dot_product(frame->east_norm, dir_perp_norm);
     double angle_az_north = acos(cos_az_north);
     double angle_az_east = acos(cos_az_east);
 
@@ -120,7 +157,7 @@ void observe(observer *obs, observation *o, TLE *tle, time_t when) {
        we act as if the earth is a perfect sphere with radius 1, this will yield the correct
        lon and lat */
     double sat_ecef[3], sat_ecef_norm[3];
-    eci_to_ecef(sat_eci, when, sat_ecef);
+    eci_to_ecef_rotated(sat_eci, frame->cos_rotation, frame->sin_rotation, sat_ecef);
     vec3_norm(sat_ecef, sat_ecef_norm);
 
     double ssp_lat = asin(sat_ecef_norm[2]);
@@ -135,7 +172,7 @@ void observe(observer *obs, observation *o, TLE *tle, time_t when) {
     o->altitude = vec3_len(sat_ecef) - vec3_len(ssp_ecef);
 
     /* Now populate the velocity-related fields */
-    memcpy(o->sat_velocity_eci, sat_velocity_eci, sizeof sat_velocity_eci);
+    memcpy(o->sat_velocity_eci, sat_velocity_eci, sizeof o->sat_velocity_eci);
     o->velocity = vec3_len(sat_velocity_eci);
 
     /* To calculate the ground-track velocity, we project the satellite's velocity (in ECEF)
@@ -143,7 +180,7 @@ void observe(observer *obs, observation *o, TLE *tle, time_t when) {
        the ground-track velocity is equal to the satellite's velocity, but for an elliptical
        orbit it may be different. */
     double sat_velocity_ecef[3];
-    eci_to_ecef(sat_velocity_eci, (double)when, sat_velocity_ecef);
+    eci_to_ecef_rotated(sat_velocity_eci, frame->cos_rotation, frame->sin_rotation, sat_velocity_ecef);
 
     DEBUG("sat_velocity_eci=(%g, %g, %g)", sat_velocity_eci[0], sat_velocity_eci[1], sat_velocity_eci[2]);
     DEBUG("sat_velocity_ecef=(%g, %g, %g)", sat_velocity_ecef[0], sat_velocity_ecef[1], sat_velocity_ecef[2]);
@@ -11,6 +11,7 @@ typedef struct {
 
 typedef struct {
     double range;
+    double range_rate;          /* In km/s, positive when the satellite moves away */
     double elevation;
     double azimuth;
     double ssp_lon, ssp_lat;
@@ -22,6 +23,37 @@ typedef struct {
     double groundtrack_direction;
 } observation;
 
+/*
+ * The parts of an observation that only depend on the observer and the time:
+ * the earth rotation, and the observer's location and directions in ECI. When
+ * many satellites are observed at the same time, these are calculated once.
+ */
+typedef struct {
+    long when;                  /* In milliseconds since 1970 */
+    double obs_ecef[3];
+    double cos_rotation, sin_rotation;
+    double obs_eci[3];
+    double obs_eci_norm[3];
+    double east_norm[3], north_norm[3];
+} observer_frame;
+
+void set_observer_frame(const observer *obs, observer_frame *frame, long when);
+
+/* Sets frame to the same observer as previous at another time, which saves
+   converting the observer's location again */
+void advance_observer_frame(const observer_frame *previous, observer_frame *frame, long when);
+
+void observe_in_frame(const observer_frame *frame, observation *o, TLE *tle);
+
+/* Like observe_in_frame, for a satellite of which the position and velocity
+   in ECI at the time of the frame are already known */
+void observe_position_in_frame(const observer_frame *frame, observation *o,
+                               const double sat_eci[3], const double sat_velocity_eci[3]);
+
 void observe(observer *obs, observation *o, TLE *tle, time_t when);
 
+/* Returns the elevation in degrees of an object at the given position in ECI,
+   such as the sun, seen from the observer of the frame */
+double elevation_in_frame(const observer_frame *frame, const double eci[3]);
+
 #endif
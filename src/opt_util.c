@@ -45,6 +45,43 @@ int optarg_as_datetime_extended(time_t *t) {
     return -1;
 }
 
+/* Parses a '.' followed by up to 3 digits, if present, as milliseconds */
+static const char *parse_millis(const char *p, long *ms) {
+    *ms = 0;
+    if(*p != '.') return p;
+    int digits = 0;
+    for(p++; digits < 3 && *p >= '0' && *p <= '9'; p++, digits++)
+        *ms = *ms * 10 + (*p - '0');
+    if(!digits) return NULL;
+    for(; digits < 3; digits++) *ms *= 10;
+    return p;
+}
+
+int optarg_as_datetime_millis(long *t) {
+    struct tm time0;
+    long ms;
+    const char *p = strptime(optarg, "%Y-%m-%dT%H:%M:%S", &time0);
+    if(!p || !(p = parse_millis(p, &ms)) || strcmp(p, "Z")) return -1;
+    *t = timegm(&time0) * 1000L + ms;
+    return 0;
+}
+
+int optarg_as_millis(long *ms, long min, long max) {
+    char *p;
+    long seconds = 0, fraction;
+    if(*optarg >= '0' && *optarg <= '9') {
+        seconds = strtol(optarg, &p, 10);
+        if(seconds > max / 1000) return -1;
+    } else {
+        p = optarg;
+    }
+    const char *end = parse_millis(p, &fraction);
+    if(!end || *end || end == optarg) return -1;
+    *ms = seconds * 1000 + fraction;
+    if(*ms < min || *ms > max) return -1;
+    return 0;
+}
+
 int optarg_as_int(signed int *i, signed int min, signed int max) {
     char *p;
     *i = strtol(optarg, &p, 10);
@@ -10,8 +10,16 @@ int optarg_as_datetime(time_t *t);
 /* Assumes optarg contains a timestamp as yyyy-mm-ddThh-mm-ssZ or just yyyy-mm-dd */
 int optarg_as_datetime_extended(time_t *t); 
 
+/* Assumes optarg contains a timestamp as yyyy-mm-ddThh:mm:ssZ, optionally with up to
+   3 decimals like yyyy-mm-ddThh:mm:ss.sssZ. The result is in milliseconds since 1970 */
+int optarg_as_datetime_millis(long *t);
+
 int optarg_as_int(signed int *i, signed int min, signed int max);
 
+/* Assumes optarg contains a number of seconds with up to 3 decimals, like 0.1.
+   The result is in milliseconds, values >= min and <= max are accepted */
+int optarg_as_millis(long *ms, long min, long max);
+
 /* Only values > min and < max are accepted */
 int optarg_as_double_excl_excl(double *d, double min, double max);
 
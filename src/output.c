@@ -4,15 +4,11 @@
 #include <time.h>
 #include <sys/time.h>
 #include <stdio.h>
-
-static void find_field(char c, const field *fields, const field_value *values, const field **f, const field_value **v) {
-    for(; fields->label; fields++, values++) 
-        if(fields->c == c) {
-            if(f) *f = fields;
-            if(v) *v = values;
-            return;
-        }
-}
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <math.h>
 
 static int is_field(char c, const field *fields) {
     for(; fields->label; fields++) 
@@ -21,102 +17,762 @@ static int is_field(char c, const field *fields) {
 }
 
 
-static void render_cols(int count, const field *fields, const field_value *values, const char *selector) {
-    struct tm fmt;
-    int first = 1;
-    for(; *selector; selector++) {
-        const field *f;
-        const field_value *v;
-        find_field(*selector, fields, values, &f, &v);
-        if(!first)
-            printf(" ");
-        switch(f->type) {
-            case fld_type_time_string:
-                gmtime_r(&v->value.time_value, &fmt);
-                printf("%04d-%02d-%02dT%02d:%02d:%02dZ", fmt.tm_year + 1900, fmt.tm_mon+1, fmt.tm_mday,
-                                                           fmt.tm_hour, fmt.tm_min, fmt.tm_sec);
-                break;
-            case fld_type_time:
-                printf("%lu", v->value.time_value);
-                break;
-            case fld_type_double:
-                printf("%g", v->value.double_value);
-                break;
-            case fld_type_string:
-                printf("%s", v->value.string_value);
-                break;
-            case fld_type_int:
-                printf("%d", v->value.int_value);   
-                break;
-        }
-        first = 0;
+/*
+ * Rendered output is collected in a buffer and written to stdout in large
+ * chunks, which is a lot cheaper than a printf per field. When stdout is a
+ * terminal, the buffer is flushed after every row, so results still show up
+ * as soon as they are rendered.
+ *
+ * Otherwise, full buffers are handed to a writer thread through a ring of
+ * NR_BUFFERS buffers, so that the calculations continue while a slow pipe or
+ * disk drains the previous output. There is only one producer and one
+ * consumer, and buffers are written in the order they were handed over.
+ * The lock is only taken once per buffer, to hand it over or to wait.
+ */
+
+#define BUFFER_SIZE (64 * 1024)
+#define NR_BUFFERS (4)
+/* The longest value that a single field (other than a string) can produce */
+#define MAX_VALUE_LENGTH (64)
+
+static char buffers[NR_BUFFERS][BUFFER_SIZE];
+static size_t lengths[NR_BUFFERS];
+static char *buffer = buffers[0];
+static size_t buffered = 0;
+static int interactive = -1;
+
+static int threaded = 0;
+static pthread_t writer;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_changed = PTHREAD_COND_INITIALIZER;
+/* Buffer n % NR_BUFFERS is in use by the writer when written <= n < submitted */
+static size_t submitted = 0, written = 0;
+
+static void *write_buffers(void *arg) {
+    (void)arg;
+    for(;;) {
+        pthread_mutex_lock(&ring_lock);
+        while(written == submitted) pthread_cond_wait(&ring_changed, &ring_lock);
+        size_t slot = written % NR_BUFFERS;
+        pthread_mutex_unlock(&ring_lock);
+
+        fwrite(buffers[slot], 1, lengths[slot], stdout);
+
+        pthread_mutex_lock(&ring_lock);
+        written++;
+        pthread_cond_broadcast(&ring_changed);
+        pthread_mutex_unlock(&ring_lock);
+    }
+    return NULL;
+}
+
+/* Hands the buffer to the writer thread and continues with the next one,
+   waiting when all buffers are still being written */
+static void submit_buffer(void) {
+    if(!buffered) return;
+    if(!threaded) {
+        fwrite(buffer, 1, buffered, stdout);
+        buffered = 0;
+        return;
     }
-    printf("\n");
+    lengths[submitted % NR_BUFFERS] = buffered;
+    pthread_mutex_lock(&ring_lock);
+    submitted++;
+    pthread_cond_broadcast(&ring_changed);
+    while(submitted - written == NR_BUFFERS) pthread_cond_wait(&ring_changed, &ring_lock);
+    pthread_mutex_unlock(&ring_lock);
+    buffer = buffers[submitted % NR_BUFFERS];
+    buffered = 0;
 }
 
-static int width = 0;
+void output_flush(void) {
+    submit_buffer();
+    if(threaded) {
+        pthread_mutex_lock(&ring_lock);
+        while(written != submitted) pthread_cond_wait(&ring_changed, &ring_lock);
+        pthread_mutex_unlock(&ring_lock);
+    }
+    fflush(stdout);
+}
 
-static void render_rows(int count, const field *fields, const field_value *values, const char *selector) {
-    if(count) {
-        for(size_t l=0; l<width; l++) printf("-");
-        printf("\n");
+static void output_start(void) {
+    if(interactive < 0) {
+        interactive = isatty(fileno(stdout));
+        /* Without a thread, output is written synchronously. With a single CPU,
+           a writer thread would only take time away from the calculations */
+        if(!interactive && sysconf(_SC_NPROCESSORS_ONLN) > 1)
+            threaded = !pthread_create(&writer, NULL, write_buffers, NULL);
+        atexit(output_flush);
     }
+}
 
-    int max = 0;
-    for(const char *s=selector; *s; s++) {
-        const field *f;
-        find_field(*s, fields, values, &f, NULL);
-        if(strlen(f->label) > max) 
-            max = strlen(f->label);
+static void output_end(void) {
+    if(interactive) output_flush();
+    else if(buffered > BUFFER_SIZE - 4 * 1024) submit_buffer();
+}
+
+/* Makes sure that at least len bytes fit in the buffer */
+static char *reserve(size_t len) {
+    if(BUFFER_SIZE - buffered < len) submit_buffer();
+    return &buffer[buffered];
+}
+
+static size_t write_char(char c) {
+    *reserve(1) = c;
+    buffered++;
+    return 1;
+}
+
+static size_t write_repeated(char c, size_t count) {
+    for(size_t l=0; l<count; l++) write_char(c);
+    return count;
+}
+
+static size_t write_string(const char *s) {
+    size_t len = strlen(s);
+    if(len > BUFFER_SIZE) {
+        output_flush();
+        fwrite(s, 1, len, stdout);
+        return len;
+    }
+    memcpy(reserve(len), s, len);
+    buffered += len;
+    return len;
+}
+
+static size_t format_unsigned(char *out, unsigned long value) {
+    char digits[24];
+    size_t len = 0;
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while(value);
+    for(size_t l=0; l<len; l++) out[l] = digits[len-l-1];
+    return len;
+}
+
+static size_t format_int(char *out, int value) {
+    if(value < 0) {
+        out[0] = '-';
+        return 1 + format_unsigned(out + 1, -(unsigned long)value);
     }
+    return format_unsigned(out, value);
+}
+
+static const double powers_of_ten[] = {
+    1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
 
-    for(const char *s=selector; *s; s++) {
-        const field *f;
-        const field_value *v;
-        find_field(*s, fields, values, &f, &v);
-        printf("%*s : ", max, f->label);
+/* Formats value exactly like printf's %g. Values between 1e-4 and 1e6 are
+   formatted with integer arithmetic; printf is used for the rest, and for
+   values that are too close to halfway between two results to be sure of
+   the rounding */
+static size_t format_double(char *out, double value) {
+    double a = value < 0 ? -value : value;
+    if(!(a >= 1e-4 && a < 1e6))
+        return snprintf(out, MAX_VALUE_LENGTH, "%g", value);
+
+    /* The decimal exponent, so that 10^exponent <= a < 10^(exponent+1) */
+    int exponent = -4;
+    while(exponent < 5 && a >= powers_of_ten[exponent + 5]) exponent++;
+
+    /* Scale to 6 significant digits. The scale is an exact power of ten, so
+       the only error is the rounding of the product */
+    double scaled = a * powers_of_ten[9 - exponent];
+    double whole = (double)(unsigned long)scaled;
+    double fraction = scaled - whole;
+    if(fraction > 0.5 - 1e-6 && fraction < 0.5 + 1e-6)
+        return snprintf(out, MAX_VALUE_LENGTH, "%g", value);
+    unsigned long digits = (unsigned long)whole + (fraction > 0.5);
+    /* A different exponent means the magnitude was misjudged or rounding
+       carried into the next power of ten */
+    if(digits < 100000 || digits > 999999)
+        return snprintf(out, MAX_VALUE_LENGTH, "%g", value);
+
+    char significant[6];
+    for(int l=5; l>=0; l--) {
+        significant[l] = '0' + digits % 10;
+        digits /= 10;
+    }
+    /* Trailing zeroes after the decimal point are dropped */
+    int nr_digits = 6;
+    while(nr_digits > exponent + 1 && nr_digits > 1 && significant[nr_digits-1] == '0') nr_digits--;
+
+    size_t len = 0;
+    if(value < 0) out[len++] = '-';
+    if(exponent < 0) {
+        out[len++] = '0';
+        out[len++] = '.';
+        for(int l=-1; l>exponent; l--) out[len++] = '0';
+        memcpy(&out[len], significant, nr_digits);
+        len += nr_digits;
+    } else {
+        memcpy(&out[len], significant, exponent + 1);
+        len += exponent + 1;
+        if(nr_digits > exponent + 1) {
+            out[len++] = '.';
+            memcpy(&out[len], &significant[exponent + 1], nr_digits - exponent - 1);
+            len += nr_digits - exponent - 1;
+        }
+    }
+    return len;
+}
+
+static size_t format_two_digits(char *out, int value) {
+    out[0] = '0' + value / 10;
+    out[1] = '0' + value % 10;
+    return 2;
+}
+
+/* Formats as yyyy-mm-ddThh:mm:ssZ. Consecutive times are usually on the same
+   day, so the date part is cached */
+static size_t format_time_string(char *out, time_t when) {
+    static time_t cached_day = 0;
+    static char cached_date[MAX_VALUE_LENGTH];
+    static size_t cached_date_len = 0;
+
+    time_t day = when / 86400, seconds = when % 86400;
+    if(seconds < 0) {
+        day--;
+        seconds += 86400;
+    }
+    if(!cached_date_len || day != cached_day) {
         struct tm fmt;
-        int w;
-        switch(f->type) {
+        gmtime_r(&when, &fmt);
+        cached_date_len = snprintf(cached_date, sizeof cached_date, "%04d-%02d-%02dT",
+                                   fmt.tm_year + 1900, fmt.tm_mon+1, fmt.tm_mday);
+        cached_day = day;
+    }
+    memcpy(out, cached_date, cached_date_len);
+    size_t len = cached_date_len;
+    len += format_two_digits(&out[len], seconds / 3600);
+    out[len++] = ':';
+    len += format_two_digits(&out[len], seconds / 60 % 60);
+    out[len++] = ':';
+    len += format_two_digits(&out[len], seconds % 60);
+    out[len++] = 'Z';
+    return len;
+}
+
+/* Splits milliseconds since the epoch in seconds and milliseconds */
+static time_t split_millis(long when, int *millis) {
+    time_t seconds = when / 1000;
+    *millis = when % 1000;
+    if(*millis < 0) {
+        seconds--;
+        *millis += 1000;
+    }
+    return seconds;
+}
+
+static size_t format_millis(char *out, int millis) {
+    out[0] = '.';
+    out[1] = '0' + millis / 100;
+    return 2 + format_two_digits(&out[2], millis % 100);
+}
+
+/* Formats as yyyy-mm-ddThh:mm:ss.sssZ */
+static size_t format_time_ms_string(char *out, long when) {
+    int millis;
+    size_t len = format_time_string(out, split_millis(when, &millis)) - 1;
+    len += format_millis(&out[len], millis);
+    out[len++] = 'Z';
+    return len;
+}
+
+static size_t write_time_ms_string(const field_value *v) {
+    size_t len = format_time_ms_string(reserve(MAX_VALUE_LENGTH), v->value.time_ms_value);
+    buffered += len;
+    return len;
+}
+
+static size_t write_time_ms(const field_value *v) {
+    int millis;
+    char *out = reserve(MAX_VALUE_LENGTH);
+    size_t len = format_unsigned(out, (unsigned long)split_millis(v->value.time_ms_value, &millis));
+    len += format_millis(&out[len], millis);
+    buffered += len;
+    return len;
+}
+
+static size_t write_time_string(const field_value *v) {
+    size_t len = format_time_string(reserve(MAX_VALUE_LENGTH), v->value.time_value);
+    buffered += len;
+    return len;
+}
+
+static size_t write_time(const field_value *v) {
+    size_t len = format_unsigned(reserve(MAX_VALUE_LENGTH), (unsigned long)v->value.time_value);
+    buffered += len;
+    return len;
+}
+
+static size_t write_double(const field_value *v) {
+    size_t len = format_double(reserve(MAX_VALUE_LENGTH), v->value.double_value);
+    buffered += len;
+    return len;
+}
+
+static size_t write_string_value(const field_value *v) {
+    return write_string(v->value.string_value);
+}
+
+static size_t write_int(const field_value *v) {
+    size_t len = format_int(reserve(MAX_VALUE_LENGTH), v->value.int_value);
+    buffered += len;
+    return len;
+}
+
+/* Strings in CSV output are quoted when they contain a separator, quote or
+   line break, with quotes doubled */
+static size_t write_csv_string(const field_value *v) {
+    const char *s = v->value.string_value;
+    if(!strpbrk(s, ",\"\r\n")) return write_string(s);
+    size_t len = write_char('"');
+    for(; *s; s++) {
+        if(*s == '"') len += write_char('"');
+        len += write_char(*s);
+    }
+    return len + write_char('"');
+}
+
+static size_t write_json_string(const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    size_t len = write_char('"');
+    for(; *s; s++) {
+        unsigned char c = *s;
+        if(c == '"' || c == '\\') {
+            len += write_char('\\');
+            len += write_char(c);
+        } else if(c < 0x20) {
+            len += write_string("\\u00");
+            len += write_char(hex[c >> 4]);
+            len += write_char(hex[c & 0xf]);
+        } else {
+            len += write_char(c);
+        }
+    }
+    return len + write_char('"');
+}
+
+static size_t write_json_string_value(const field_value *v) {
+    return write_json_string(v->value.string_value);
+}
+
+static size_t write_json_time_string(const field_value *v) {
+    size_t len = write_char('"');
+    len += write_time_string(v);
+    return len + write_char('"');
+}
+
+static size_t write_json_time_ms_string(const field_value *v) {
+    size_t len = write_char('"');
+    len += write_time_ms_string(v);
+    return len + write_char('"');
+}
+
+/* JSON has no infinity or NaN */
+static size_t write_json_double(const field_value *v) {
+    if(!isfinite(v->value.double_value)) return write_string("null");
+    return write_double(v);
+}
+
+/* Binary values are written in little-endian byte order, whatever the host uses */
+static size_t write_little_endian(uint64_t value, size_t size) {
+    char *out = reserve(size);
+    for(size_t l=0; l<size; l++)
+        out[l] = (char)(value >> (8 * l));
+    buffered += size;
+    return size;
+}
+
+static size_t write_binary_time(const field_value *v) {
+    return write_little_endian((uint64_t)(int64_t)v->value.time_value, 8);
+}
+
+static size_t write_binary_time_ms(const field_value *v) {
+    return write_little_endian((uint64_t)(int64_t)v->value.time_ms_value, 8);
+}
+
+static size_t write_binary_double(const field_value *v) {
+    uint64_t bits;
+    memcpy(&bits, &v->value.double_value, sizeof bits);
+    return write_little_endian(bits, 8);
+}
+
+static size_t write_binary_string(const field_value *v) {
+    /* Truncated or padded with NULs */
+    char *out = reserve(OUTPUT_STRING_SIZE);
+    strncpy(out, v->value.string_value, OUTPUT_STRING_SIZE);
+    buffered += OUTPUT_STRING_SIZE;
+    return OUTPUT_STRING_SIZE;
+}
+
+static size_t write_binary_int(const field_value *v) {
+    return write_little_endian((uint32_t)(int32_t)v->value.int_value, 4);
+}
+
+/* Writes a value, returns the number of characters written */
+typedef size_t (*value_writer)(const field_value *v);
+
+#define MAX_NAME_LENGTH (31)
+
+struct output_step {
+    const field *field;
+    size_t index;        /* Index of the value in the values passed to render */
+    value_writer write;
+    size_t padding;      /* Spaces before the label when rendering rows */
+    char name[MAX_NAME_LENGTH+1]; /* The short label, made unique */
+    size_t size;         /* The size of the value in binary and npy output */
+    char type;           /* The type in binary output */
+    char npy_type[8];
+    char key[MAX_NAME_LENGTH+5]; /* "name": in ndjson output, or the empty string */
+    size_t key_length;
+};
+
+/* Returns the function that writes values of the given type in the given format */
+static value_writer select_writer(int type, output_format format) {
+    switch(format) {
+        case output_rows:
+        case output_cols:
+        case output_csv:
+            break;
+        case output_ndjson:
+            switch(type) {
+                case fld_type_time_string: return write_json_time_string;
+                case fld_type_time_ms_string: return write_json_time_ms_string;
+                case fld_type_double: return write_json_double;
+                case fld_type_string: return write_json_string_value;
+            }
+            break;
+        case output_binary:
+        case output_npy:
+            switch(type) {
+                /* Both are seconds since the epoch in binary output */
+                case fld_type_time_string:
+                case fld_type_time: return write_binary_time;
+                case fld_type_time_ms_string:
+                case fld_type_time_ms: return write_binary_time_ms;
+                case fld_type_double: return write_binary_double;
+                case fld_type_string: return write_binary_string;
+                case fld_type_int: return write_binary_int;
+            }
+            break;
+    }
+    switch(type) {
+        case fld_type_time_string: return write_time_string;
+        case fld_type_time: return write_time;
+        case fld_type_time_ms_string: return write_time_ms_string;
+        case fld_type_time_ms: return write_time_ms;
+        case fld_type_double: return write_double;
+        case fld_type_string: return format == output_csv ? write_csv_string : write_string_value;
+        default: return write_int;
+    }
+}
+
+/* Gives every step a unique name, since both t and T are called time, for example */
+static void name_steps(output_plan *plan) {
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        output_step *step = &plan->steps[l];
+        snprintf(step->name, sizeof step->name, "%s", step->field->label_short);
+        for(int suffix=2; ; suffix++) {
+            size_t same = 0;
+            while(same < l && strcmp(plan->steps[same].name, step->name)) same++;
+            if(same == l) break;
+            snprintf(step->name, sizeof step->name, "%.24s_%d", step->field->label_short, suffix % 1000);
+        }
+    }
+}
+
+output_plan *plan_output(const field *fields, const char *selector, output_format format) {
+    if(check_selector(fields, selector)) return NULL;
+
+    output_plan *plan = malloc(sizeof(output_plan));
+    if(!plan) return NULL;
+    plan->nr_steps = strlen(selector);
+    plan->format = format;
+    plan->row_width = 0;
+    plan->started = 0;
+    plan->header_pos = -1;
+    plan->nr_rows = 0;
+    plan->expected_rows = 0;
+    plan->steps = malloc((plan->nr_steps ? plan->nr_steps : 1) * sizeof(output_step));
+    if(!plan->steps) {
+        free(plan);
+        return NULL;
+    }
+
+    size_t max = 0;
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        output_step *step = &plan->steps[l];
+        step->index = 0;
+        while(fields[step->index].c != selector[l]) step->index++;
+        step->field = &fields[step->index];
+        step->write = select_writer(step->field->type, format);
+        switch(step->field->type) {
             case fld_type_time_string:
-                gmtime_r(&v->value.time_value, &fmt);
-                printf("%04d-%02d-%02dT%02d:%02d:%02dZ%n", fmt.tm_year + 1900, fmt.tm_mon+1, fmt.tm_mday,
-                                                           fmt.tm_hour, fmt.tm_min, fmt.tm_sec, &w);
-                break;
             case fld_type_time:
-                printf("%lu%n", v->value.time_value, &w);
+                step->type = 't';
+                strcpy(step->npy_type, "<i8");
+                step->size = 8;
+                break;
+            case fld_type_time_ms_string:
+            case fld_type_time_ms:
+                /* Both are milliseconds since the epoch in binary output */
+                step->type = 'm';
+                strcpy(step->npy_type, "<M8[ms]");
+                step->size = 8;
                 break;
             case fld_type_double:
-                printf("%g%n", v->value.double_value, &w);
+                step->type = 'f';
+                strcpy(step->npy_type, "<f8");
+                step->size = 8;
                 break;
             case fld_type_string:
-                printf("%s%n", v->value.string_value, &w);
+                step->type = 's';
+                snprintf(step->npy_type, sizeof step->npy_type, "|S%d", OUTPUT_STRING_SIZE);
+                step->size = OUTPUT_STRING_SIZE;
                 break;
             case fld_type_int:
-                printf("%d%n", v->value.int_value, &w);
+                step->type = 'i';
+                strcpy(step->npy_type, "<i4");
+                step->size = 4;
                 break;
         }
-        if(!count && max+w+3 > width) width=max+w+3;
-        printf("\n");
+        if(strlen(step->field->label) > max)
+            max = strlen(step->field->label);
+    }
+    /* Labels are right-aligned */
+    for(size_t l=0; l<plan->nr_steps; l++)
+        plan->steps[l].padding = max - strlen(plan->steps[l].field->label);
+    plan->label_width = max;
+    name_steps(plan);
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        output_step *step = &plan->steps[l];
+        step->key_length = format == output_ndjson ?
+            (size_t)snprintf(step->key, sizeof step->key, "%s\"%s\":", l ? "," : "", step->name) : 0;
+        step->key[step->key_length] = 0;
+    }
+
+    return plan;
+}
+
+/*
+ * The header of binary output is, with all numbers little-endian:
+ *   char magic[8]          "OTBINARY"
+ *   uint32 version         1
+ *   uint32 nr_fields
+ *   uint32 record_size     the sum of the field sizes
+ *   uint32 header_size     including the field descriptions
+ * followed by a description of each field:
+ *   char name[32]          padded with NULs
+ *   char type              t: int64 seconds since the epoch, m: int64
+ *                          milliseconds since the epoch, f: float64,
+ *                          i: int32, s: string padded with NULs
+ *   char reserved[3]
+ *   uint32 size
+ * and then the records. The number of records follows from the file size.
+ */
+#define BINARY_MAGIC "OTBINARY"
+#define BINARY_VERSION (1)
+#define BINARY_FIELD_SIZE (40)
+
+static void write_binary_header(output_plan *plan) {
+    size_t record_size = 0;
+    for(size_t l=0; l<plan->nr_steps; l++) record_size += plan->steps[l].size;
+    write_string(BINARY_MAGIC);
+    write_little_endian(BINARY_VERSION, 4);
+    write_little_endian(plan->nr_steps, 4);
+    write_little_endian(record_size, 4);
+    write_little_endian(24 + plan->nr_steps * BINARY_FIELD_SIZE, 4);
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        char *out = reserve(BINARY_FIELD_SIZE);
+        memset(out, 0, BINARY_FIELD_SIZE);
+        strncpy(out, plan->steps[l].name, MAX_NAME_LENGTH+1);
+        out[32] = plan->steps[l].type;
+        buffered += 36;
+        write_little_endian(plan->steps[l].size, 4);
     }
 }
 
-void render(int count, const field *fields, const field_value *values, const char *selector, int rows) {
-    if(rows) render_rows(count, fields, values, selector);
-    else render_cols(count, fields, values, selector);
+/* The number of rows in an npy header is written with a fixed width, so it
+   can be replaced when the output is finished */
+#define NPY_SHAPE_WIDTH (20)
+#define NPY_PREFIX_SIZE (10)
+#define NPY_ALIGNMENT (64)
+
+static char *npy_header(const output_plan *plan, size_t nr_rows, size_t *shape_offset) {
+    size_t size = 128 + plan->nr_steps * (MAX_NAME_LENGTH + 32);
+    char *header = malloc(size);
+    if(!header) return NULL;
+    size_t len = snprintf(header, size, "{'descr': [");
+    for(size_t l=0; l<plan->nr_steps; l++)
+        len += snprintf(&header[len], size - len, "%s('%s', '%s')", l ? ", " : "",
+                        plan->steps[l].name, plan->steps[l].npy_type);
+    len += snprintf(&header[len], size - len, "], 'fortran_order': False, 'shape': (");
+    *shape_offset = NPY_PREFIX_SIZE + len;
+    len += snprintf(&header[len], size - len, "%*zu,), }", NPY_SHAPE_WIDTH, nr_rows);
+    /* The header is padded with spaces and ends in a newline, so that the
+       data is aligned */
+    while((NPY_PREFIX_SIZE + len + 1) % NPY_ALIGNMENT) header[len++] = ' ';
+    header[len++] = '\n';
+    header[len] = 0;
+    return header;
 }
 
-void render_headers(const field *fields, const char *selector) {
-    int first = 1;
-    for(; *selector; selector++) {
-        const field *f;
-        find_field(*selector, fields, NULL, &f, NULL);
-        if(!first) printf(" ");
-        printf("%s", f->label_short);
-        first = 0;
+static void write_npy_header(output_plan *plan) {
+    size_t shape_offset;
+    char *header = npy_header(plan, plan->expected_rows, &shape_offset);
+    if(!header) return;
+    size_t len = strlen(header);
+    write_string("\x93NUMPY");
+    write_char(1);
+    write_char(0);
+    write_little_endian(len, 2);
+    write_string(header);
+    free(header);
+}
+
+static void start_binary_output(output_plan *plan) {
+    output_start();
+    /* The position of stdout is only known when all output has been written */
+    output_flush();
+    long long pos = ftello(stdout);
+    plan->header_pos = pos < 0 ? -1 : pos;
+    if(plan->format == output_npy) write_npy_header(plan);
+    else write_binary_header(plan);
+    plan->started = 1;
+}
+
+/* Replaces the number of rows in the npy header, returns 0 on success */
+static int patch_npy_header(const output_plan *plan) {
+    size_t shape_offset;
+    char *header = npy_header(plan, plan->nr_rows, &shape_offset);
+    if(!header) return -1;
+    output_flush();
+    long long end = ftello(stdout);
+    int result = -1;
+    if(plan->header_pos >= 0 && end >= 0 &&
+       !fseeko(stdout, plan->header_pos + shape_offset, SEEK_SET)) {
+        fprintf(stdout, "%*zu", NPY_SHAPE_WIDTH, plan->nr_rows);
+        result = fseeko(stdout, end, SEEK_SET);
     }
-    printf("\n");
+    free(header);
+    return result;
+}
 
+/* CSV output always starts with a row of field names */
+static void write_csv_header(output_plan *plan) {
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        if(l) write_char(',');
+        write_string(plan->steps[l].name);
+    }
+    write_char('\n');
+    plan->started = 1;
+}
+
+void close_output(output_plan *plan) {
+    if(!plan) return;
+    if(plan->format == output_csv && !plan->started) {
+        output_start();
+        write_csv_header(plan);
+    }
+    if(plan->format == output_binary || plan->format == output_npy) {
+        if(!plan->started) start_binary_output(plan);
+        if(plan->format == output_npy && plan->nr_rows != plan->expected_rows && patch_npy_header(plan))
+            fprintf(stderr, "Warning: could not write the number of rows (%zu) into the npy header, "
+                            "since the output is not seekable\n", plan->nr_rows);
+    }
+    free(plan->steps);
+    free(plan);
+}
+
+static void render_cols(const output_plan *plan, const field_value *values) {
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        if(l) write_char(' ');
+        plan->steps[l].write(&values[plan->steps[l].index]);
+    }
+    write_char('\n');
+}
+
+static void render_csv(output_plan *plan, const field_value *values) {
+    if(!plan->started) write_csv_header(plan);
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        if(l) write_char(',');
+        plan->steps[l].write(&values[plan->steps[l].index]);
+    }
+    write_char('\n');
+}
+
+/* One JSON object per line, with the field names as keys */
+static void render_ndjson(const output_plan *plan, const field_value *values) {
+    write_char('{');
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        const output_step *step = &plan->steps[l];
+        memcpy(reserve(step->key_length), step->key, step->key_length);
+        buffered += step->key_length;
+        step->write(&values[step->index]);
+    }
+    write_string("}\n");
+}
+
+static void render_rows(int count, output_plan *plan, const field_value *values) {
+    if(count) {
+        write_repeated('-', plan->row_width);
+        write_char('\n');
+    }
+
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        const output_step *step = &plan->steps[l];
+        write_repeated(' ', step->padding);
+        write_string(step->field->label);
+        write_string(" : ");
+        int w = step->write(&values[step->index]);
+        if(!count && plan->label_width+w+3 > plan->row_width) plan->row_width = plan->label_width+w+3;
+        write_char('\n');
+    }
+}
+
+static void render_record(output_plan *plan, const field_value *values) {
+    if(!plan->started) start_binary_output(plan);
+    for(size_t l=0; l<plan->nr_steps; l++)
+        plan->steps[l].write(&values[plan->steps[l].index]);
+    plan->nr_rows++;
+}
+
+void render(int count, output_plan *plan, const field_value *values) {
+    output_start();
+    switch(plan->format) {
+        case output_rows: render_rows(count, plan, values); break;
+        case output_cols: render_cols(plan, values); break;
+        case output_csv: render_csv(plan, values); break;
+        case output_ndjson: render_ndjson(plan, values); break;
+        case output_binary:
+        case output_npy: render_record(plan, values); break;
+    }
+    output_end();
+}
+
+void render_headers(const output_plan *plan) {
+    if(plan->format != output_rows && plan->format != output_cols) return;
+    output_start();
+    for(size_t l=0; l<plan->nr_steps; l++) {
+        if(l) write_char(' ');
+        write_string(plan->steps[l].field->label_short);
+    }
+    write_char('\n');
+    output_end();
+}
+
+int parse_output_format(const char *s, output_format *format) {
+    if(!strncmp("rows", s, strlen(s))) *format = output_rows;
+    else if(!strncmp("cols", s, strlen(s))) *format = output_cols;
+    else if(!strncmp("csv", s, strlen(s))) *format = output_csv;
+    else if(!strncmp("ndjson", s, strlen(s))) *format = output_ndjson;
+    else if(!strncmp("binary", s, strlen(s))) *format = output_binary;
+    else if(!strncmp("npy", s, strlen(s))) *format = output_npy;
+    else return -1;
+    return 0;
 }
 
 int check_selector(const field *fields, const char *selector) {
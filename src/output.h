@@ -1,6 +1,7 @@
 #ifndef _OUTPUT_H_
 #define _OUTPUT_H_
 
+#include <stddef.h>
 #include <sys/time.h>
 
 typedef struct {
@@ -9,6 +10,8 @@ typedef struct {
     enum {
         fld_type_time_string,
         fld_type_time, /* Time as number of seconds since epoch */
+        fld_type_time_ms_string, /* Like fld_type_time_string, with milliseconds */
+        fld_type_time_ms,        /* Like fld_type_time, with milliseconds */
         fld_type_double,
         fld_type_string,
         fld_type_int
@@ -18,6 +21,7 @@ typedef struct {
 typedef struct {
     union {
         time_t time_value;
+        long time_ms_value; /* Milliseconds since epoch, for the _ms types */
         double double_value;
         const char *string_value;
         int int_value;
@@ -26,7 +30,60 @@ typedef struct {
 
 int check_selector(const field *fields, const char *selector);
 
-void render(int count, const field *fields, const field_value *values, const char *selector, int rows);
+typedef enum {
+    output_rows,
+    output_cols,
+    output_csv,     /* Comma-separated values, starting with a row of field names */
+    output_ndjson,  /* A JSON object per row, with the field names as keys */
+    output_binary,  /* A header describing the fields, followed by fixed-size records */
+    output_npy      /* A NumPy .npy file containing an array of records */
+} output_format;
 
-void render_headers(const field *fields, const char *selector);
+/* Parses rows, cols, csv, ndjson, binary or npy, or an abbreviation of those. Returns 0 on success */
+int parse_output_format(const char *s, output_format *format);
+
+/* Binary and npy output store strings in fixed-size fields of this many bytes */
+#define OUTPUT_STRING_SIZE (24)
+
+typedef struct output_step output_step;
+
+/*
+ * A selector compiled into the steps needed to render a row: for every
+ * selected field, the index of its value and the function that formats it.
+ * This is done once, so rendering a row does not look up any fields.
+ */
+typedef struct {
+    size_t nr_steps;
+    output_step *steps;
+    output_format format;
+    int label_width;   /* The length of the longest label */
+    int row_width;     /* The width of the separator between rows */
+
+    int started;          /* Set once the header of csv, binary or npy output has been written */
+
+    /* Only used for binary and npy output */
+    long long header_pos; /* Position of the header in stdout, -1 if unknown */
+    size_t nr_rows;
+    size_t expected_rows; /* The number of rows in the npy header, when known in advance */
+} output_plan;
+
+/* Returns NULL when the selector contains characters that are not in fields */
+output_plan *plan_output(const field *fields, const char *selector, output_format format);
+
+/* Finishes the output and frees the plan. For npy output this writes the final
+   number of rows into the header, which requires stdout to be seekable unless
+   expected_rows was right */
+void close_output(output_plan *plan);
+
+/* values must be in the same order as the fields that the plan was made from */
+void render(int count, output_plan *plan, const field_value *values);
+
+/* Does nothing for csv, ndjson, binary and npy output, which have their own
+   header or none */
+void render_headers(const output_plan *plan);
+
+/* Rendered output is buffered, and flushed when the program exits. Call this
+   before writing anything else to stdout, or to make sure that everything
+   rendered so far has been written */
+void output_flush(void);
 #endif
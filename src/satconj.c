@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <math.h>
+#include <sysexits.h>
+#include <getopt.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "opt_util.h"
+#include "tle_loader.h"
+#include "selection.h"
+#include "TLE.h"
+#include "util.h"
+#include "output.h"
+#include "version.h"
+#include "debug.h"
+#include "workers.h"
+
+static char *executable;
+
+static void usage(void) {
+    printf("Usage: %s [OPTION...] [<TLE-FILE>]\n", executable);
+    printf("\n");
+    printf("Finds the close approaches between the satellites in <TLE-FILE>: the times at\n");
+    printf("which two of them are closest to each other while within the given distance.\n");
+    printf("\n");
+    printf("<TLE-FILE> is a file containing one or more TLEs. Use\n");
+    printf("- to read the TLEs from stdin. If <TLE-FILE> is not supplied\n");
+    printf("then $ORBIT_TOOLS_TLE must be set to the filename to be used\n");
+    printf("\n");
+    printf("Options are:\n");
+    printf("-h,--help                 : Print this help and exit\n");
+    printf("-V,--version              : Print version and exit\n");
+    printf("-v,--verbose              : Print debug logging\n");
+    printf("-S,--select=<SELECTION>   : Only use the selected satellites from the TLE file.\n");
+    printf("                            <SELECTION> is a comma-separated list of names,\n");
+    printf("                            patterns like FLOCK*, catalog numbers and ranges of\n");
+    printf("                            catalog numbers like 40000-40100.\n");
+    printf("-P,--primary=<SELECTION>  : Only find the close approaches of the satellites in\n");
+    printf("                            <SELECTION>, formatted like for --select, with each\n");
+    printf("                            other and with all other satellites. The default is\n");
+    printf("                            to screen all satellites against each other.\n");
+    printf("-d,--distance=<DISTANCE>  : The largest distance of a close approach, in km. The\n");
+    printf("                            default is 5.\n");
+    printf("-s,--start=<START>        : The start of the period, specified as\n");
+    printf("                            yyyy-mm-ddThh:mm:ssZ or yyyy-mm-dd. The default is\n");
+    printf("                            the current date and time.\n");
+    printf("-E,--end=<END>            : The end of the period, specified like the start.\n");
+    printf("                            The default is one day after the start.\n");
+    printf("-i,--interval=<INTERVAL>  : The time between the moments at which the positions\n");
+    printf("                            are compared, in seconds, at most 60. The default\n");
+    printf("                            is 10. This does not change the results, only the\n");
+    printf("                            time needed.\n");
+    printf("   --threads=<THREADS>    : The number of threads used to calculate positions.\n");
+    printf("                            The default is the number of CPUs.\n");
+    printf("-f,--format=rows|cols|csv|ndjson|binary|npy\n");
+    printf("                          : Sets the output format. The default is cols.\n");
+    printf("-H,--headers              : When the format is cols, first print a row with headers\n");
+    printf("-F,--fields=<FIELDS>      : Specifies the fields to include in the output.\n");
+    printf("                            <FIELDS> is a string consisting of:\n");
+    printf("                            t: The time of closest approach, formatted\n");
+    printf("                            T: The time of closest approach, in seconds since the\n");
+    printf("                               epoch, with milliseconds\n");
+    printf("                            n: The name of the (primary) satellite\n");
+    printf("                            c: The catalog number of the (primary) satellite\n");
+    printf("                            N: The name of the other satellite\n");
+    printf("                            C: The catalog number of the other satellite\n");
+    printf("                            d: The distance at closest approach, in km\n");
+    printf("                            v: The relative velocity at closest approach, in km/s\n");
+    printf("                            The default is tnNdv\n");
+    printf("\n");
+    printf("The close approaches are ordered by time, which is accurate to the millisecond.\n");
+    printf("Only closest approaches within the period are found.\n");
+}
+
+static void usage_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n\n%s --help for help\n", msg, executable);
+    exit(EX_USAGE);
+}
+
+#define OPT_THREADS (256)
+
+static field fields[] = {
+    { "Time of closest approach", "tca", 't', fld_type_time_ms_string },
+    { "Time of closest approach", "tca", 'T', fld_type_time_ms },
+    { "Satellite", "satellite", 'n', fld_type_string },
+    { "Catalog number", "catalog_number", 'c', fld_type_int },
+    { "Other satellite", "other_satellite", 'N', fld_type_string },
+    { "Other catalog number", "other_catalog_number", 'C', fld_type_int },
+    { "Distance", "distance", 'd', fld_type_double },
+    { "Relative velocity", "relative_velocity", 'v', fld_type_double },
+    { NULL }
+};
+
+/*
+ * The screening has three steps. First, two satellites are only compared
+ * when their ranges of distance to the center of the earth overlap. The
+ * ranges are those of the osculating orbits at the start and end of the
+ * period, so that decay is taken into account, widened by a pad for the
+ * perturbations within an orbit. Satellites whose range does not overlap
+ * with that of any primary satellite are not propagated at all.
+ *
+ * Then, at every moment, the satellites are put in a spatial hash of cubic
+ * cells, large enough that two satellites that come within the distance in
+ * the half interval around the moment are in the same or neighbouring cells.
+ * For the pairs found, the closest approach of the linearized relative motion
+ * within the half interval tells whether they may come close. Finally, the
+ * time of closest approach of those candidates is found by bisection on the
+ * range rate, using SGP4. A moment only reports the closest approaches in its
+ * own half interval, so that each is reported once.
+ */
+
+/* The largest difference found between the distance of a satellite to the
+   center of the earth and its osculating perigee or apogee, over a week,
+   is about 25km */
+#define PERIGEE_APOGEE_PAD (50.0)
+
+/* The relative acceleration of two satellites is at most twice the
+   gravitational acceleration at the surface of the earth, in km/s^2 */
+#define MAX_RELATIVE_ACCELERATION (2 * 9.81e-3)
+
+/* A batch contains at most this many positions and velocities */
+#define BATCH_STATES (65536)
+
+typedef struct {
+    size_t tle;
+    int catalog_number;
+    int primary;
+    double perigee, apogee;     /* Distances to the center of the earth, in km */
+} object;
+
+typedef struct {
+    long when;                  /* In milliseconds since 1970 */
+    size_t first, second;       /* Indexes in the catalog */
+    double distance, velocity;
+} approach;
+
+/* The TLEs of the propagation are copies of those of the objects, in the
+   same order */
+typedef struct {
+    propagation p;              /* In ECI, with velocities */
+    object *objects;
+    size_t nr_objects;
+    long first;                 /* The first moment of the batch, in milliseconds since 1970 */
+    size_t nr_moments;
+    long interval;              /* In milliseconds */
+} batch;
+
+typedef struct {
+    batch *b;
+    size_t first, last;
+} worker;
+
+static void *propagate(void *arg) {
+    worker *w = arg;
+    propagate_tles(&w->b->p, w->first, w->last, 0, w->b->nr_moments);
+    return NULL;
+}
+
+/* Sets the perigee and apogee to the distances to the center of the earth
+   of the osculating orbit at the given time. Returns non-zero when SGP4
+   fails */
+static int osculating_range(TLE *tle, long when, double *perigee, double *apogee) {
+    double r[3], v[3];
+    getRVForDate(tle, when, r, v);
+    if(tle->sgp4Error) return -1;
+    double mu = tle->rec.xke * tle->rec.xke / 3600.0 *
+                tle->rec.radiusearthkm * tle->rec.radiusearthkm * tle->rec.radiusearthkm;
+    double r_len = vec3_len(r);
+    double energy = dot_product(v, v) / 2 - mu / r_len;
+    if(energy >= 0) return -1;
+    double a = -mu / (2 * energy);
+    double h[3];
+    cross_product(r, v, h);
+    double p = dot_product(h, h) / mu;
+    double e = p < a ? sqrt(1 - p / a) : 0;
+    *perigee = a * (1 - e);
+    *apogee = a * (1 + e);
+    return 0;
+}
+
+static int ranges_overlap(const object *a, const object *b, double distance) {
+    return a->perigee <= b->apogee + distance && b->perigee <= a->apogee + distance;
+}
+
+/* The relative position and velocity of second with respect to first */
+static void relative_state(TLE *first, TLE *second, long when, double position[3], double velocity[3]) {
+    double r1[3], v1[3], r2[3], v2[3];
+    getRVForDate(first, when, r1, v1);
+    getRVForDate(second, when, r2, v2);
+    vec3_sub(r2, r1, position);
+    vec3_sub(v2, v1, velocity);
+}
+
+/* Finds the time of closest approach between lo and hi, in milliseconds.
+   Returns non-zero when the distance does not have a minimum there. The
+   interval is short enough to contain at most one minimum or maximum */
+static int closest_approach(TLE *first, TLE *second, long lo, long hi, approach *a) {
+    double position[3], velocity[3];
+    relative_state(first, second, lo, position, velocity);
+    if(first->sgp4Error || second->sgp4Error || dot_product(position, velocity) > 0) return -1;
+    relative_state(first, second, hi, position, velocity);
+    if(first->sgp4Error || second->sgp4Error || dot_product(position, velocity) <= 0) return -1;
+
+    /* The range rate goes from negative at lo to positive at hi */
+    while(hi - lo > 1) {
+        long mid = lo + (hi - lo) / 2;
+        relative_state(first, second, mid, position, velocity);
+        if(first->sgp4Error || second->sgp4Error) return -1;
+        if(dot_product(position, velocity) <= 0) lo = mid;
+        else hi = mid;
+    }
+    double lo_distance, hi_distance;
+    relative_state(first, second, hi, position, velocity);
+    hi_distance = vec3_len(position);
+    relative_state(first, second, lo, position, velocity);
+    lo_distance = vec3_len(position);
+    if(hi_distance < lo_distance) {
+        relative_state(first, second, hi, position, velocity);
+        lo = hi;
+    }
+    a->when = lo;
+    a->distance = vec3_len(position);
+    a->velocity = vec3_len(velocity);
+    return 0;
+}
+
+/*
+ * The spatial hash of one moment. Every slot holds the first object in it,
+ * plus one, and next links the other objects in the same slot. Different
+ * cells may share a slot, so the cell of every object is compared.
+ */
+typedef struct {
+    size_t nr_slots;            /* A power of 2 */
+    size_t *slots;
+    size_t *next;
+    long *cells;                /* cells[object * 3] */
+    double cell_size;
+} spatial_hash;
+
+static size_t hash_slot(const spatial_hash *h, long x, long y, long z) {
+    unsigned long hash = (unsigned long)x * 73856093UL ^ (unsigned long)y * 19349663UL ^
+                         (unsigned long)z * 83492791UL;
+    return hash & (h->nr_slots - 1);
+}
+
+typedef struct {
+    approach *approaches;
+    size_t count, size;
+} approach_list;
+
+static int add_approach(approach_list *list, const approach *a) {
+    if(list->count == list->size) {
+        size_t size = list->size ? list->size * 2 : 64;
+        approach *approaches = realloc(list->approaches, size * sizeof(approach));
+        if(!approaches) return -1;
+        list->approaches = approaches;
+        list->size = size;
+    }
+    list->approaches[list->count++] = *a;
+    return 0;
+}
+
+static int compare_approaches(const void *a, const void *b) {
+    const approach *aa = a, *ab = b;
+    if(aa->when != ab->when) return aa->when < ab->when ? -1 : 1;
+    if(aa->first != ab->first) return aa->first < ab->first ? -1 : 1;
+    return aa->second < ab->second ? -1 : aa->second > ab->second;
+}
+
+typedef struct {
+    const batch *b;
+    TLE *tles;
+    double distance;
+    long start, end;            /* The period, in milliseconds since 1970 */
+    spatial_hash hash;
+    long nr_candidates, nr_refined;
+} screening;
+
+/* Finds the close approaches in the half interval around the given moment of
+   the batch, and adds them to list. Returns non-zero when out of memory */
+static int screen_moment(screening *s, size_t moment, approach_list *list) {
+    const batch *b = s->b;
+    const double *states = &b->p.states[moment * b->nr_objects * 6];
+    long when = b->first + (long)moment * b->interval;
+    double half = b->interval / 2000.0;
+
+    /* Relative positions change by at most this much in half an interval */
+    double max_speed = 0;
+    for(size_t o=0; o<b->nr_objects; o++) {
+        double speed = vec3_len(&states[o * 6 + 3]);
+        if(speed > max_speed) max_speed = speed;
+    }
+    double deviation = MAX_RELATIVE_ACCELERATION * half * half / 2;
+    spatial_hash *h = &s->hash;
+    h->cell_size = s->distance + deviation + 2 * max_speed * half;
+
+    memset(h->slots, 0, h->nr_slots * sizeof(size_t));
+    for(size_t o=0; o<b->nr_objects; o++) {
+        const double *position = &states[o * 6];
+        if(isnan(position[0])) continue;
+        long *cell = &h->cells[o * 3];
+        for(int l=0; l<3; l++) cell[l] = (long)floor(position[l] / h->cell_size);
+        size_t slot = hash_slot(h, cell[0], cell[1], cell[2]);
+        h->next[o] = h->slots[slot];
+        h->slots[slot] = o + 1;
+    }
+
+    long lo = when - b->interval / 2, hi = when + b->interval / 2;
+    if(lo < s->start) lo = s->start;
+    if(hi > s->end) hi = s->end;
+    for(size_t o=0; o<b->nr_objects; o++) {
+        const object *first = &b->objects[o];
+        const double *state = &states[o * 6];
+        if(!first->primary || isnan(state[0])) continue;
+        const long *cell = &h->cells[o * 3];
+        for(int dx=-1; dx<=1; dx++) for(int dy=-1; dy<=1; dy++) for(int dz=-1; dz<=1; dz++) {
+            long x = cell[0] + dx, y = cell[1] + dy, z = cell[2] + dz;
+            for(size_t entry=h->slots[hash_slot(h, x, y, z)]; entry; entry=h->next[entry-1]) {
+                size_t other = entry - 1;
+                const long *other_cell = &h->cells[other * 3];
+                if(other_cell[0] != x || other_cell[1] != y || other_cell[2] != z) continue;
+                /* Pairs of primaries are handled once */
+                const object *second = &b->objects[other];
+                if(other == o || (second->primary && other < o)) continue;
+                /* Multiple TLEs of the same satellite are not compared */
+                if(first->catalog_number >= 0 && first->catalog_number == second->catalog_number) continue;
+                if(!ranges_overlap(first, second, s->distance)) continue;
+
+                /* The closest approach of the linearized relative motion
+                   within the half interval */
+                const double *other_state = &states[other * 6];
+                double position[3], velocity[3];
+                vec3_sub(other_state, state, position);
+                vec3_sub(other_state + 3, state + 3, velocity);
+                double speed_sq = dot_product(velocity, velocity);
+                double t = speed_sq > 0 ? -dot_product(position, velocity) / speed_sq : 0;
+                if(t < -half) t = -half;
+                if(t > half) t = half;
+                double closest[3] = { position[0] + t * velocity[0], position[1] + t * velocity[1],
+                                      position[2] + t * velocity[2] };
+                s->nr_candidates++;
+                if(vec3_len(closest) > s->distance + deviation) continue;
+
+                s->nr_refined++;
+                approach a;
+                a.first = first->tle;
+                a.second = second->tle;
+                if(closest_approach(&s->tles[first->tle], &s->tles[second->tle], lo, hi, &a) ||
+                   a.distance > s->distance)
+                    continue;
+                if(add_approach(list, &a)) return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    executable = argv[0];
+    struct option longopts[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'V' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "select", required_argument, NULL, 'S' },
+        { "primary", required_argument, NULL, 'P' },
+        { "distance", required_argument, NULL, 'd' },
+        { "start", required_argument, NULL, 's' },
+        { "end", required_argument, NULL, 'E' },
+        { "interval", required_argument, NULL, 'i' },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "format", required_argument, NULL, 'f' },
+        { "fields", required_argument, NULL, 'F' },
+        { "headers", no_argument, NULL, 'H' },
+        { NULL }
+    };
+
+    opterr = 0;
+    int c;
+    struct timeval now;
+    gettimeofday(&now, 0);
+    time_t start = now.tv_sec, end = 0;
+    int has_end = 0;
+    int interval = 10;
+    double distance = 5;
+    selection *sel = NULL, *primary = NULL;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nr_threads = nr_cpus > 1 ? (int)nr_cpus : 1;
+    char *selector = NULL;
+    int headers = 0;
+    output_format fmt = output_cols;
+
+    while((c = getopt_long(argc, argv, "hVvS:P:d:s:E:i:f:F:H", longopts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                exit(0);
+            case 'V':
+                printf("%s\n", VERSION);
+                exit(0);
+            case 'v':
+                debug_enable(1);
+                break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
+            case 'P':
+                free_selection(primary);
+                if(!(primary = parse_selection(optarg)))
+                    usage_error("Invalid primary selection");
+                break;
+            case 'd':
+                if(arg_as_double_excl_excl(optarg, &distance, 0, 100000))
+                    usage_error("Invalid distance");
+                break;
+            case 's':
+                if(optarg_as_datetime_extended(&start))
+                    usage_error("Invalid start");
+                break;
+            case 'E':
+                if(optarg_as_datetime_extended(&end))
+                    usage_error("Invalid end");
+                has_end = 1;
+                break;
+            case 'i':
+                if(optarg_as_int(&interval, 1, 60))
+                    usage_error("Invalid interval");
+                break;
+            case OPT_THREADS:
+                if(optarg_as_int(&nr_threads, 1, 1024))
+                    usage_error("Invalid number of threads");
+                break;
+            case 'f':
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
+                break;
+            case 'F':
+                if(check_selector(fields, optarg))
+                    usage_error("Invalid fields-string");
+                free(selector);
+                selector = strdup(optarg);
+                break;
+            case 'H':
+                headers = 1;
+                break;
+            default:
+                usage_error("Invalid option");
+                break;
+        }
+    }
+
+    char *file = NULL;
+    if(optind == argc-1) file = argv[argc-1];
+    else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
+    else usage_error("Supply a filename or set ORBIT_TOOLS_TLE");
+
+    if(!has_end) end = start + 24 * 3600;
+    if(end <= start) usage_error("The end must be after the start");
+
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to read file");
+    if(!cat->count) usage_error("No satellites found");
+
+    /* The range of every satellite, which is unbounded when SGP4 fails at the
+       start or end */
+    object *objects = malloc(cat->count * sizeof(object));
+    if(!objects) usage_error("Out of memory");
+    size_t nr_primaries = 0;
+    for(size_t t=0; t<cat->count; t++) {
+        object *o = &objects[t];
+        o->tle = t;
+        o->catalog_number = cat->catalog_numbers[t];
+        o->primary = !primary || is_selected(primary, cat->names[t], cat->catalog_numbers[t]);
+        nr_primaries += o->primary;
+        double perigee_start, apogee_start, perigee_end, apogee_end;
+        if(osculating_range(&cat->tles[t], start * 1000L, &perigee_start, &apogee_start) ||
+           osculating_range(&cat->tles[t], end * 1000L, &perigee_end, &apogee_end)) {
+            o->perigee = 0;
+            o->apogee = INFINITY;
+        } else {
+            o->perigee = fmin(perigee_start, perigee_end) - PERIGEE_APOGEE_PAD;
+            o->apogee = fmax(apogee_start, apogee_end) + PERIGEE_APOGEE_PAD;
+        }
+    }
+    if(!nr_primaries) usage_error("No primary satellites found");
+
+    /* Only the satellites that may come close to a primary are kept. The
+       primaries are gathered first, so every satellite is only compared with
+       them rather than with the whole catalog */
+    object *primaries = malloc(nr_primaries * sizeof(object));
+    if(!primaries) usage_error("Out of memory");
+    for(size_t t=0, p=0; t<cat->count; t++)
+        if(objects[t].primary) primaries[p++] = objects[t];
+    size_t nr_objects = 0;
+    for(size_t t=0; t<cat->count; t++) {
+        int keep = objects[t].primary;
+        for(size_t p=0; p<nr_primaries && !keep; p++)
+            keep = ranges_overlap(&primaries[p], &objects[t], distance);
+        if(keep) objects[nr_objects++] = objects[t];
+    }
+    free(primaries);
+    DEBUG("%zu satellites, %zu primaries, %zu satellites after the perigee and apogee filter",
+          cat->count, nr_primaries, nr_objects);
+
+    /* The moments are start, start + interval, ... each covering half an
+       interval on either side, up to the end */
+    long interval_ms = interval * 1000L;
+    long nr_moments = (2 * (long)(end - start) * 1000L + interval_ms) / (2 * interval_ms) + 1;
+    if(start * 1000L + (nr_moments - 1) * interval_ms - interval_ms / 2 >= end * 1000L) nr_moments--;
+    size_t per_batch = BATCH_STATES / nr_objects;
+    if(per_batch < 1) per_batch = 1;
+    if(per_batch > nr_moments) per_batch = nr_moments;
+
+    TLE *tles = malloc(nr_objects * sizeof(TLE));
+    long *times = malloc(per_batch * sizeof(long));
+    batch b = { { tles, nr_objects, calloc(nr_objects, 1), times, NULL, 1,
+                  malloc(per_batch * nr_objects * 6 * sizeof(double)) },
+                objects, nr_objects, start * 1000L, 0, interval_ms };
+    screening s = { &b, cat->tles, distance, start * 1000L, end * 1000L };
+    s.hash.nr_slots = 1024;
+    while(s.hash.nr_slots < 2 * nr_objects) s.hash.nr_slots *= 2;
+    s.hash.slots = malloc(s.hash.nr_slots * sizeof(size_t));
+    s.hash.next = malloc(nr_objects * sizeof(size_t));
+    s.hash.cells = malloc(nr_objects * 3 * sizeof(long));
+    if(nr_threads > nr_objects) nr_threads = nr_objects;
+    worker *workers = malloc(nr_threads * sizeof(worker));
+    if(!tles || !times || !b.p.failed || !b.p.states || !s.hash.slots || !s.hash.next || !s.hash.cells ||
+       !workers)
+        usage_error("Out of memory");
+    for(size_t o=0; o<nr_objects; o++) tles[o] = cat->tles[objects[o].tle];
+    for(int l=0; l<nr_threads; l++) {
+        workers[l].b = &b;
+        workers[l].first = nr_objects * l / nr_threads;
+        workers[l].last = nr_objects * (l+1) / nr_threads;
+    }
+
+    output_plan *plan = plan_output(fields, selector ? selector : "tnNdv", fmt);
+    if(fmt == output_cols && headers) render_headers(plan);
+    field_value values[sizeof fields / sizeof fields[0] - 1];
+    int rendered = 0;
+    int result = 0;
+    approach_list list = { NULL, 0, 0 };
+
+    for(long done=0; done<nr_moments && !result; done+=b.nr_moments) {
+        b.first = start * 1000L + done * interval_ms;
+        b.nr_moments = nr_moments - done < per_batch ? nr_moments - done : per_batch;
+        for(size_t m=0; m<b.nr_moments; m++) times[m] = b.first + (long)m * interval_ms;
+        run_workers(workers, sizeof(worker), nr_threads, propagate);
+        for(size_t m=0; m<b.nr_moments; m++) {
+            list.count = 0;
+            if(screen_moment(&s, m, &list)) {
+                fprintf(stderr, "Error: out of memory\n");
+                result = EX_OSERR;
+                break;
+            }
+            if(list.count) qsort(list.approaches, list.count, sizeof(approach), compare_approaches);
+            for(size_t a=0; a<list.count; a++) {
+                const approach *ap = &list.approaches[a];
+                values[0].value.time_ms_value = ap->when;
+                values[1].value.time_ms_value = ap->when;
+                values[2].value.string_value = cat->names[ap->first] ? cat->names[ap->first] : "unknown";
+                values[3].value.int_value = cat->catalog_numbers[ap->first];
+                values[4].value.string_value = cat->names[ap->second] ? cat->names[ap->second] : "unknown";
+                values[5].value.int_value = cat->catalog_numbers[ap->second];
+                values[6].value.double_value = ap->distance;
+                values[7].value.double_value = ap->velocity;
+                render(rendered++, plan, values);
+            }
+        }
+    }
+    DEBUG("%ld candidate pairs, %ld refined", s.nr_candidates, s.nr_refined);
+
+    report_sgp4_failures(b.p.failed, nr_objects, "whose approaches are left out while it fails");
+
+    close_output(plan);
+    free(list.approaches);
+    free(workers);
+    free(s.hash.slots);
+    free(s.hash.next);
+    free(s.hash.cells);
+    free(b.p.failed);
+    free(b.p.states);
+    free(tles);
+    free(times);
+    free(objects);
+    unload_tles(cat);
+    free_selection(sel);
+    free_selection(primary);
+    free(selector);
+    return result;
+}
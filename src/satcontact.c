@@ -0,0 +1,555 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <math.h>
+#include <sysexits.h>
+#include <getopt.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "opt_util.h"
+#include "tle_loader.h"
+#include "selection.h"
+#include "TLE.h"
+#include "observer.h"
+#include "locations.h"
+#include "ssp_index.h"
+#include "util.h"
+#include "output.h"
+#include "version.h"
+#include "debug.h"
+#include "workers.h"
+
+static char *executable;
+
+static void usage(void) {
+    printf("Usage: %s [OPTION...] [<TLE-FILE>]\n", executable);
+    printf("\n");
+    printf("Calculates the contact windows between a (large) number of terminals on the\n");
+    printf("ground and the satellites in <TLE-FILE>: the periods during which a satellite\n");
+    printf("is visible from a terminal with at least the minimum elevation.\n");
+    printf("\n");
+    printf("<TLE-FILE> is a file containing one or more TLEs. Use\n");
+    printf("- to read the TLEs from stdin. If <TLE-FILE> is not supplied\n");
+    printf("then $ORBIT_TOOLS_TLE must be set to the filename to be used\n");
+    printf("\n");
+    printf("Options are:\n");
+    printf("-h,--help                      : Print this help and exit\n");
+    printf("-V,--version                   : Print version and exit\n");
+    printf("-v,--verbose                   : Print debug logging\n");
+    printf("-l,--location=<LAT,LON>        : Add a terminal on the ground, in degrees. Can be\n");
+    printf("                                 given more than once.\n");
+    printf("-L,--locations=<FILE>          : Add the terminals in <FILE>, which has a location\n");
+    printf("                                 formatted as LAT,LON on every line, optionally\n");
+    printf("                                 followed by a space and a name, like the output\n");
+    printf("                                 of termgen. Use - to read them from stdin.\n");
+    printf("-S,--select=<SELECTION>        : Only use the selected satellites from the TLE\n");
+    printf("                                 file. <SELECTION> is a comma-separated list of\n");
+    printf("                                 names, patterns like FLOCK*, catalog numbers and\n");
+    printf("                                 ranges of catalog numbers like 40000-40100.\n");
+    printf("-e,--min-elevation=<ELEVATION> : A satellite is visible when its elevation is at\n");
+    printf("                                 least <ELEVATION> degrees. The default is 0.\n");
+    printf("-s,--start=<START>             : The start of the period, specified as\n");
+    printf("                                 yyyy-mm-ddThh:mm:ssZ or yyyy-mm-dd. The default is\n");
+    printf("                                 the current date and time.\n");
+    printf("-E,--end=<END>                 : The end of the period, specified like the start.\n");
+    printf("                                 The default is one day after the start.\n");
+    printf("-i,--interval=<INTERVAL>       : The time between the moments at which visibility\n");
+    printf("                                 is determined, in seconds. The default is 10.\n");
+    printf("   --cell-size=<DEGREES>       : The terminals are grouped in cells of about\n");
+    printf("                                 <DEGREES> by <DEGREES>, and only those in the\n");
+    printf("                                 cells that the footprint of a satellite reaches\n");
+    printf("                                 are checked. The default is 2.\n");
+    printf("   --threads=<THREADS>         : The number of threads. The default is the number\n");
+    printf("                                 of CPUs.\n");
+    printf("-f,--format=rows|cols|csv|ndjson|binary|npy\n");
+    printf("                               : Sets the output format. The default is cols.\n");
+    printf("-H,--headers                   : When the format is cols, first print a row with headers\n");
+    printf("-F,--fields=<FIELDS>           : Specifies the fields to include in the output.\n");
+    printf("                                 <FIELDS> is a string consisting of:\n");
+    printf("                                 L: The name of the terminal\n");
+    printf("                                 a: The latitude of the terminal\n");
+    printf("                                 o: The longitude of the terminal\n");
+    printf("                                 n: The name of the satellite\n");
+    printf("                                 s: The start of the contact, formatted\n");
+    printf("                                 S: The start of the contact, in seconds since the epoch\n");
+    printf("                                 e: The end of the contact, formatted\n");
+    printf("                                 E: The end of the contact, in seconds since the epoch\n");
+    printf("                                 t: The time of the best elevation, formatted\n");
+    printf("                                 T: The time of the best elevation, in seconds since\n");
+    printf("                                    the epoch\n");
+    printf("                                 d: The duration of the contact, in seconds\n");
+    printf("                                 l: The best elevation, in degrees\n");
+    printf("                                 The default is Lnsedl\n");
+    printf("\n");
+    printf("The start of a contact is the first moment at which the satellite is visible,\n");
+    printf("the end the first moment after that at which it is not, so both are accurate\n");
+    printf("to the interval. Contacts in progress at the start or end of the period are\n");
+    printf("cut off there. The contacts are ordered by their end.\n");
+}
+
+static void usage_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n\n%s --help for help\n", msg, executable);
+    exit(EX_USAGE);
+}
+
+#define OPT_CELL_SIZE (256)
+#define OPT_THREADS (257)
+
+static field fields[] = {
+    { "Terminal", "terminal", 'L', fld_type_string },
+    { "Latitude", "latitude", 'a', fld_type_double },
+    { "Longitude", "longitude", 'o', fld_type_double },
+    { "Satellite", "satellite", 'n', fld_type_string },
+    { "Contact start", "contact_start", 's', fld_type_time_string },
+    { "Contact start", "contact_start", 'S', fld_type_time },
+    { "Contact end", "contact_end", 'e', fld_type_time_string },
+    { "Contact end", "contact_end", 'E', fld_type_time },
+    { "Time of best elevation", "best_time", 't', fld_type_time_string },
+    { "Time of best elevation", "best_time", 'T', fld_type_time },
+    { "Duration", "duration", 'd', fld_type_time },
+    { "Best elevation", "elevation", 'l', fld_type_double },
+    { NULL }
+};
+
+/* A terminal on the ground, which is in a fixed cell of the index */
+typedef struct {
+    const location *where;
+    double ecef[3], up[3];
+    size_t cell;
+    unsigned int nr_open;       /* The number of contacts in progress */
+} terminal;
+
+typedef struct {
+    unsigned int satellite;
+    long start;
+    long best_time;
+    double best_sin_elevation;
+} contact;
+
+typedef struct {
+    const terminal *t;
+    contact c;
+    long end;
+} closed_contact;
+
+/*
+ * The period is handled in batches of moments. For every batch, the positions
+ * of the satellites at all its moments are calculated first. Then the
+ * terminals, sorted by cell, are divided over the threads, which each go
+ * through the moments of the batch on their own. At every moment a thread
+ * puts the footprints of the satellites in its index, which lists for every
+ * cell the satellites that may be visible from it, but only for the rows of
+ * cells its terminals are in. A terminal only checks the satellites of its
+ * cell, so the work depends on the number of terminals in the cells that
+ * footprints reach, rather than on the number of terminals times the number
+ * of satellites.
+ *
+ * The contacts in progress are kept per thread, for its terminals in order,
+ * and sorted by satellite for each terminal, like the satellites of a cell.
+ * At every moment they are merged with the satellites that are visible into
+ * a new list. The contacts that end are collected for the whole batch, in
+ * order of the moment they end.
+ */
+
+/* A batch contains at most this many positions */
+#define BATCH_POSITIONS (65536)
+
+typedef struct {
+    propagation p;              /* In ECEF */
+    terminal *terminals;
+    double sin_min_elevation, sin_sq_min_elevation;
+    long first;                 /* The first moment of the batch, in seconds since 1970 */
+    size_t nr_moments;
+    int interval;
+} batch;
+
+typedef struct {
+    batch *b;
+    size_t first_tle, last_tle;
+    size_t first_terminal, last_terminal;
+    ssp_index *index;           /* For the cells of the terminals */
+    contact *open, *next;       /* The contacts in progress, and those at the next moment */
+    size_t nr_open, open_size, next_size;
+    closed_contact *closed;     /* The contacts that ended during the batch */
+    size_t nr_closed, closed_size;
+    size_t nr_rendered;         /* The number of closed contacts that have been rendered */
+    int out_of_memory;
+} worker;
+
+static void *propagate(void *arg) {
+    worker *w = arg;
+    propagate_tles(&w->b->p, w->first_tle, w->last_tle, 0, w->b->nr_moments);
+    return NULL;
+}
+
+/* The elevation is the angle between the direction of the satellite and the
+   plane perpendicular to the terminal's position vector, as in observe().
+   When the satellite is visible, sets sin_elevation to the sine of it */
+static int is_visible(const terminal *t, const double sat_ecef[3], const batch *b, double *sin_elevation) {
+    double dir[3] = { sat_ecef[0] - t->ecef[0], sat_ecef[1] - t->ecef[1], sat_ecef[2] - t->ecef[2] };
+    double up = dot_product(dir, t->up);
+    if(!(up >= 0)) return 0;
+    double range_sq = dot_product(dir, dir);
+    if(up * up < b->sin_sq_min_elevation * range_sq) return 0;
+    *sin_elevation = up / sqrt(range_sq);
+    return 1;
+}
+
+/* Makes room for at least count more elements in an array of the given size */
+static int reserve(void **array, size_t *size, size_t used, size_t count, size_t element_size) {
+    if(used + count <= *size) return 0;
+    size_t size_needed = *size ? *size * 2 : 1024;
+    while(size_needed < used + count) size_needed *= 2;
+    void *larger = realloc(*array, size_needed * element_size);
+    if(!larger) return -1;
+    *array = larger;
+    *size = size_needed;
+    return 0;
+}
+
+/* Updates the contacts of the terminals of the worker at the given moment of
+   the batch, for which its index has been built. Returns non-zero when out
+   of memory */
+static int update_contacts(worker *w, size_t moment) {
+    batch *b = w->b;
+    const double *positions = &b->p.states[moment * b->p.nr_tles * 3];
+    long when = b->first + (long)moment * b->interval;
+    size_t nr_next = 0;
+    const contact *was = w->open;
+    for(size_t l=w->first_terminal; l<w->last_terminal; l++) {
+        terminal *t = &b->terminals[l];
+        const unsigned int *candidates;
+        size_t nr_candidates = query_ssp_index_cell(w->index, t->cell, &candidates);
+        if(reserve((void **)&w->next, &w->next_size, nr_next, nr_candidates, sizeof(contact)) ||
+           reserve((void **)&w->closed, &w->closed_size, w->nr_closed, t->nr_open, sizeof(closed_contact)))
+            return -1;
+
+        /* Both the candidates and the contacts in progress are sorted by
+           satellite. A contact ends when its satellite is no longer a
+           candidate or no longer visible */
+        const contact *was_end = was + t->nr_open;
+        unsigned int nr_open = 0;
+        for(size_t c=0; c<nr_candidates; c++) {
+            unsigned int s = candidates[c];
+            while(was < was_end && was->satellite < s)
+                w->closed[w->nr_closed++] = (closed_contact){ t, *was++, when };
+            double sin_elevation;
+            int visible = is_visible(t, &positions[s * 3], b, &sin_elevation);
+            if(was < was_end && was->satellite == s) {
+                if(!visible) {
+                    w->closed[w->nr_closed++] = (closed_contact){ t, *was++, when };
+                    continue;
+                }
+                contact *next = &w->next[nr_next++];
+                *next = *was++;
+                if(sin_elevation > next->best_sin_elevation) {
+                    next->best_sin_elevation = sin_elevation;
+                    next->best_time = when;
+                }
+                nr_open++;
+            } else if(visible) {
+                w->next[nr_next++] = (contact){ s, when, when, sin_elevation };
+                nr_open++;
+            }
+        }
+        while(was < was_end)
+            w->closed[w->nr_closed++] = (closed_contact){ t, *was++, when };
+        t->nr_open = nr_open;
+    }
+
+    contact *open = w->open;
+    size_t open_size = w->open_size;
+    w->open = w->next;
+    w->open_size = w->next_size;
+    w->nr_open = nr_next;
+    w->next = open;
+    w->next_size = open_size;
+    return 0;
+}
+
+static void *find_contacts(void *arg) {
+    worker *w = arg;
+    batch *b = w->b;
+    w->nr_closed = 0;
+    w->nr_rendered = 0;
+    if(w->first_terminal == w->last_terminal) return NULL;
+    for(size_t m=0; m<b->nr_moments; m++) {
+        if(build_ssp_index(w->index, &b->p.states[m * b->p.nr_tles * 3], b->p.nr_tles) ||
+           update_contacts(w, m)) {
+            w->out_of_memory = 1;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Ends all contacts in progress of the terminals of the worker. Returns
+   non-zero when out of memory */
+static int end_contacts(worker *w, long end) {
+    const contact *was = w->open;
+    w->nr_closed = 0;
+    w->nr_rendered = 0;
+    if(reserve((void **)&w->closed, &w->closed_size, 0, w->nr_open, sizeof(closed_contact))) return -1;
+    for(size_t l=w->first_terminal; l<w->last_terminal; l++) {
+        terminal *t = &w->b->terminals[l];
+        for(unsigned int c=0; c<t->nr_open; c++)
+            w->closed[w->nr_closed++] = (closed_contact){ t, *was++, end };
+        t->nr_open = 0;
+    }
+    w->nr_open = 0;
+    return 0;
+}
+
+/* Renders the contacts that the workers closed up to the given time, in the
+   order of the workers, and returns the number of rows rendered so far */
+static int render_contacts(worker *workers, int nr_workers, const tle_catalog *cat, output_plan *plan,
+                           int rendered, long until) {
+    field_value values[sizeof fields / sizeof fields[0] - 1];
+    for(int l=0; l<nr_workers; l++) {
+        worker *w = &workers[l];
+        for(; w->nr_rendered<w->nr_closed && w->closed[w->nr_rendered].end<=until; w->nr_rendered++) {
+            const closed_contact *closed = &w->closed[w->nr_rendered];
+            const char *name = cat->names[closed->c.satellite];
+            values[0].value.string_value = closed->t->where->name;
+            values[1].value.double_value = closed->t->where->lat;
+            values[2].value.double_value = closed->t->where->lon;
+            values[3].value.string_value = name ? name : "unknown";
+            values[4].value.time_value = closed->c.start;
+            values[5].value.time_value = closed->c.start;
+            values[6].value.time_value = closed->end;
+            values[7].value.time_value = closed->end;
+            values[8].value.time_value = closed->c.best_time;
+            values[9].value.time_value = closed->c.best_time;
+            values[10].value.time_value = closed->end - closed->c.start;
+            values[11].value.double_value = rad_to_deg(asin(closed->c.best_sin_elevation));
+            render(rendered++, plan, values);
+        }
+    }
+    return rendered;
+}
+
+static int compare_terminals(const void *a, const void *b) {
+    const terminal *ta = a, *tb = b;
+    if(ta->cell != tb->cell) return ta->cell < tb->cell ? -1 : 1;
+    /* Keep the order of the file within a cell */
+    return ta->where < tb->where ? -1 : ta->where > tb->where;
+}
+
+int main(int argc, char *argv[]) {
+    executable = argv[0];
+    struct option longopts[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'V' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "location", required_argument, NULL, 'l' },
+        { "locations", required_argument, NULL, 'L' },
+        { "select", required_argument, NULL, 'S' },
+        { "min-elevation", required_argument, NULL, 'e' },
+        { "start", required_argument, NULL, 's' },
+        { "end", required_argument, NULL, 'E' },
+        { "interval", required_argument, NULL, 'i' },
+        { "cell-size", required_argument, NULL, OPT_CELL_SIZE },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "format", required_argument, NULL, 'f' },
+        { "fields", required_argument, NULL, 'F' },
+        { "headers", no_argument, NULL, 'H' },
+        { NULL }
+    };
+
+    opterr = 0;
+    int c;
+    struct timeval now;
+    gettimeofday(&now, 0);
+    time_t start = now.tv_sec, end = 0;
+    int has_end = 0;
+    int interval = 10;
+    double cell_size = 2;
+    location_list locations = { NULL, 0, 0 };
+    selection *sel = NULL;
+    int min_elevation = 0;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nr_threads = nr_cpus > 1 ? (int)nr_cpus : 1;
+    char *selector = NULL;
+    int headers = 0;
+    output_format fmt = output_cols;
+
+    while((c = getopt_long(argc, argv, "hVvl:L:S:e:s:E:i:f:F:H", longopts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                exit(0);
+            case 'V':
+                printf("%s\n", VERSION);
+                exit(0);
+            case 'v':
+                debug_enable(1);
+                break;
+            case 'l': {
+                double lat, lon;
+                if(optarg_as_lon_lat(&lon, &lat))
+                    usage_error("Invalid location");
+                if(add_location(&locations, optarg, lat, lon))
+                    usage_error("Out of memory");
+                break;
+            }
+            case 'L':
+                if(read_locations(&locations, optarg))
+                    usage_error("Failed to read locations");
+                break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
+            case 'e':
+                if(optarg_as_int(&min_elevation, 0, 90))
+                    usage_error("Invalid elevation");
+                break;
+            case 's':
+                if(optarg_as_datetime_extended(&start))
+                    usage_error("Invalid start");
+                break;
+            case 'E':
+                if(optarg_as_datetime_extended(&end))
+                    usage_error("Invalid end");
+                has_end = 1;
+                break;
+            case 'i':
+                if(optarg_as_int(&interval, 1, INT_MAX))
+                    usage_error("Invalid interval");
+                break;
+            case OPT_CELL_SIZE:
+                if(arg_as_double_excl_excl(optarg, &cell_size, 0, 180))
+                    usage_error("Invalid cell size");
+                break;
+            case OPT_THREADS:
+                if(optarg_as_int(&nr_threads, 1, 1024))
+                    usage_error("Invalid number of threads");
+                break;
+            case 'f':
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
+                break;
+            case 'F':
+                if(check_selector(fields, optarg))
+                    usage_error("Invalid fields-string");
+                free(selector);
+                selector = strdup(optarg);
+                break;
+            case 'H':
+                headers = 1;
+                break;
+            default:
+                usage_error("Invalid option");
+                break;
+        }
+    }
+
+    char *file = NULL;
+    if(optind == argc-1) file = argv[argc-1];
+    else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
+    else usage_error("Supply a filename or set ORBIT_TOOLS_TLE");
+
+    if(!has_end) end = start + 24 * 3600;
+    if(end <= start) usage_error("The end must be after the start");
+    if(!locations.count) usage_error("No terminals given");
+
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to read file");
+    if(!cat->count) usage_error("No satellites found");
+
+    ssp_index *index = create_ssp_index(cell_size, min_elevation);
+    size_t nr_terminals = locations.count;
+    terminal *terminals = calloc(nr_terminals, sizeof(terminal));
+    if(!index || !terminals) usage_error("Out of memory");
+    for(size_t l=0; l<nr_terminals; l++) {
+        terminal *t = &terminals[l];
+        t->where = &locations.locations[l];
+        observer obs = { t->where->lon, t->where->lat, 0 };
+        observer_frame frame;
+        set_observer_frame(&obs, &frame, 0);
+        vec3_copy(t->ecef, frame.obs_ecef);
+        vec3_norm(t->ecef, t->up);
+        t->cell = ssp_index_cell(index, t->ecef);
+    }
+    qsort(terminals, nr_terminals, sizeof(terminal), compare_terminals);
+
+    /* The moments are start, start + interval, ... up to but not including end */
+    long nr_moments = ((long)(end - start) + interval - 1) / interval;
+    size_t per_batch = BATCH_POSITIONS / cat->count;
+    if(per_batch < 1) per_batch = 1;
+    if(per_batch > nr_moments) per_batch = nr_moments;
+
+    double sin_min_elevation = sin(deg_to_rad(min_elevation));
+    long *times = malloc(per_batch * sizeof(long));
+    double *rotations = malloc(per_batch * 2 * sizeof(double));
+    batch b = { { cat->tles, cat->count, calloc(cat->count, 1), times, rotations, 0,
+                  malloc(per_batch * cat->count * 3 * sizeof(double)) },
+                terminals, sin_min_elevation, sin_min_elevation * sin_min_elevation,
+                start, 0, interval };
+    worker *workers = calloc(nr_threads, sizeof(worker));
+    if(!times || !rotations || !b.p.failed || !b.p.states || !workers) usage_error("Out of memory");
+    for(int l=0; l<nr_threads; l++) {
+        workers[l].b = &b;
+        workers[l].first_tle = cat->count * l / nr_threads;
+        workers[l].last_tle = cat->count * (l+1) / nr_threads;
+        workers[l].first_terminal = nr_terminals * l / nr_threads;
+        workers[l].last_terminal = nr_terminals * (l+1) / nr_threads;
+        if(workers[l].first_terminal == workers[l].last_terminal) continue;
+        workers[l].index = l ? create_ssp_index(cell_size, min_elevation) : index;
+        if(!workers[l].index) usage_error("Out of memory");
+        restrict_ssp_index(workers[l].index, terminals[workers[l].first_terminal].cell,
+                           terminals[workers[l].last_terminal - 1].cell);
+    }
+    DEBUG("%zu satellites, %zu terminals, %ld moments, %zu moments per batch, %d threads",
+          cat->count, nr_terminals, nr_moments, per_batch, nr_threads);
+
+    output_plan *plan = plan_output(fields, selector ? selector : "Lnsedl", fmt);
+    if(fmt == output_cols && headers) render_headers(plan);
+    int rendered = 0;
+    int result = 0;
+
+    for(long done=0; done<nr_moments && !result; done+=b.nr_moments) {
+        b.first = start + done * interval;
+        b.nr_moments = nr_moments - done < per_batch ? nr_moments - done : per_batch;
+        for(size_t m=0; m<b.nr_moments; m++) {
+            times[m] = (b.first + (long)m * interval) * 1000L;
+            earth_rotation(b.first + (long)m * interval, &rotations[2*m], &rotations[2*m+1]);
+        }
+        run_workers(workers, sizeof(worker), nr_threads, propagate);
+        run_workers(workers, sizeof(worker), nr_threads, find_contacts);
+        for(int l=0; l<nr_threads; l++)
+            if(workers[l].out_of_memory) result = EX_OSERR;
+        for(size_t m=0; m<b.nr_moments && !result; m++)
+            rendered = render_contacts(workers, nr_threads, cat, plan, rendered, b.first + (long)m * interval);
+    }
+
+    for(int l=0; l<nr_threads && !result; l++)
+        if(end_contacts(&workers[l], end)) result = EX_OSERR;
+    if(result) fprintf(stderr, "Error: out of memory\n");
+    else render_contacts(workers, nr_threads, cat, plan, rendered, end);
+
+    report_sgp4_failures(b.p.failed, cat->count, "whose contacts are down while it fails");
+
+    close_output(plan);
+    for(int l=0; l<nr_threads; l++) {
+        free(workers[l].open);
+        free(workers[l].next);
+        free(workers[l].closed);
+        if(l) free_ssp_index(workers[l].index);
+    }
+    free(workers);
+    free(terminals);
+    free_ssp_index(index);
+    free_locations(&locations);
+    free(b.p.failed);
+    free(b.p.states);
+    free(times);
+    free(rotations);
+    unload_tles(cat);
+    free_selection(sel);
+    free(selector);
+    return result;
+}
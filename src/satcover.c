@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <math.h>
+#include <sysexits.h>
+#include <getopt.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "opt_util.h"
+#include "tle_loader.h"
+#include "selection.h"
+#include "TLE.h"
+#include "util.h"
+#include "output.h"
+#include "version.h"
+#include "debug.h"
+#include "workers.h"
+
+/* The earth is treated as a sphere with this radius when calculating footprints */
+#define EARTH_RADIUS (6371.0)
+
+static char *executable;
+
+static void usage(void) {
+    printf("Usage: %s [OPTION...] [<TLE-FILE>]\n", executable);
+    printf("\n");
+    printf("Calculates, for every cell of a grid covering the earth, the fraction of\n");
+    printf("time that at least one of the satellites in <TLE-FILE> is visible from the\n");
+    printf("center of the cell with at least the minimum elevation.\n");
+    printf("\n");
+    printf("<TLE-FILE> is a file containing one or more TLEs. Use\n");
+    printf("- to read the TLEs from stdin. If <TLE-FILE> is not supplied\n");
+    printf("then $ORBIT_TOOLS_TLE must be set to the filename to be used\n");
+    printf("\n");
+    printf("Options are:\n");
+    printf("-h,--help                      : Print this help and exit\n");
+    printf("-V,--version                   : Print version and exit\n");
+    printf("-v,--verbose                   : Print debug logging\n");
+    printf("-S,--select=<SELECTION>        : Only use the selected satellites from the TLE\n");
+    printf("                                 file. <SELECTION> is a comma-separated list of\n");
+    printf("                                 names, patterns like FLOCK*, catalog numbers and\n");
+    printf("                                 ranges of catalog numbers like 40000-40100.\n");
+    printf("-e,--min-elevation=<ELEVATION> : A cell is covered when a satellite has an\n");
+    printf("                                 elevation of at least <ELEVATION> degrees. The\n");
+    printf("                                 default is 0.\n");
+    printf("-r,--resolution=<DEGREES>      : The size of the grid cells in degrees of latitude\n");
+    printf("                                 and longitude, which must divide 180. The\n");
+    printf("                                 default is 1.\n");
+    printf("-s,--start=<START>             : The start of the period, specified as\n");
+    printf("                                 yyyy-mm-ddThh:mm:ssZ or yyyy-mm-dd. The default is\n");
+    printf("                                 the current date and time.\n");
+    printf("-E,--end=<END>                 : The end of the period, specified like the start.\n");
+    printf("                                 The default is one day after the start.\n");
+    printf("-i,--interval=<INTERVAL>       : The time between the moments at which coverage is\n");
+    printf("                                 determined, in seconds. The default is 60.\n");
+    printf("   --threads=<THREADS>         : The number of threads, each handling a band of\n");
+    printf("                                 latitudes. The default is the number of CPUs.\n");
+    printf("-f,--format=rows|cols|csv|ndjson|binary|npy\n");
+    printf("                               : Sets the output format. The default is cols.\n");
+    printf("-H,--headers                   : When the format is cols, first print a row with headers\n");
+    printf("-F,--fields=<FIELDS>           : Specifies the fields to include in the output.\n");
+    printf("                                 <FIELDS> is a string consisting of:\n");
+    printf("                                 a: The latitude of the center of the cell\n");
+    printf("                                 o: The longitude of the center of the cell\n");
+    printf("                                 c: The fraction of time the cell is covered\n");
+    printf("                                 C: The number of moments the cell is covered\n");
+    printf("                                 The default is aoc\n");
+}
+
+static void usage_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n\n%s --help for help\n", msg, executable);
+    exit(EX_USAGE);
+}
+
+#define OPT_THREADS (256)
+
+static field fields[] = {
+    { "Latitude", "latitude", 'a', fld_type_double },
+    { "Longitude", "longitude", 'o', fld_type_double },
+    { "Coverage", "coverage", 'c', fld_type_double },
+    { "Covered", "covered", 'C', fld_type_int },
+    { NULL }
+};
+
+/*
+ * The grid has rows of cells of equal latitude, from south to north, with
+ * the cells in a row from west to east. The sine and cosine of the latitude of
+ * the center of each row are calculated in advance.
+ */
+typedef struct {
+    double resolution;  /* In radians */
+    int nr_rows, nr_cols;
+    double *sin_lat, *cos_lat;
+} grid;
+
+/*
+ * The period is handled in batches of moments. For every batch, the positions
+ * of the satellites at all its moments are calculated first, and replaced by
+ * their footprints. Then the rows of the grid are divided over the threads,
+ * which each go through the moments of the batch for their rows, so all
+ * threads count in the same grid. A cell is counted at most once per moment,
+ * no matter how many satellites cover it: the footprints of all satellites are
+ * first marked in visible, and the rows between first_marked and last_marked
+ * are then added to covered.
+ */
+
+/* A batch contains at most this many positions */
+#define BATCH_POSITIONS (65536)
+
+typedef struct {
+    const grid *g;
+    propagation p;          /* In ECEF, then replaced by the latitude and longitude of
+                               the sub-satellite point and the radius of the footprint */
+    double cos_min_elevation, min_elevation; /* In radians */
+    size_t nr_moments;
+    int *covered;           /* For each cell, the number of moments it is covered */
+} batch;
+
+typedef struct {
+    batch *b;
+    size_t first_tle, last_tle;
+    int first_row, last_row;    /* The rows of the grid to count, including last_row */
+    unsigned char *visible;     /* For each cell in those rows, set when it is covered
+                                   at the current moment */
+    int first_marked, last_marked;
+} worker;
+
+/*
+ * The footprint of a satellite is the cap around the sub-satellite point
+ * where the satellite's elevation is at least the minimum. Its radius is the
+ * earth central angle between the sub-satellite point and the edge of the
+ * footprint, which is 0 when the footprint is empty or SGP4 failed.
+ */
+static void *propagate(void *arg) {
+    worker *w = arg;
+    batch *b = w->b;
+    propagate_tles(&b->p, w->first_tle, w->last_tle, 0, b->nr_moments);
+    for(size_t m=0; m<b->nr_moments; m++) {
+        for(size_t t=w->first_tle; t<w->last_tle; t++) {
+            double *position = &b->p.states[(m * b->p.nr_tles + t) * 3];
+            double r = vec3_len(position);
+            double cos_nadir = EARTH_RADIUS / r * b->cos_min_elevation;
+            double cap = cos_nadir < 1.0 ? acos(cos_nadir) - b->min_elevation : 0;
+            double ssp_lat = asin(position[2] / r);
+            double ssp_lon = atan2(position[1], position[0]);
+            position[0] = ssp_lat;
+            position[1] = ssp_lon;
+            position[2] = cap;
+        }
+    }
+    return NULL;
+}
+
+static void mark_cells(worker *w, int row, int first_col, int last_col) {
+    size_t row_size = w->b->g->nr_cols;
+    memset(w->visible + (size_t)(row - w->first_row) * row_size + first_col, 1, last_col - first_col + 1);
+    if(row < w->first_marked) w->first_marked = row;
+    if(row > w->last_marked) w->last_marked = row;
+}
+
+/*
+ * Marks the cells of the worker's rows with their center in the footprint.
+ * Only the rows that intersect the cap are visited, and in each row the range
+ * of longitudes inside the cap follows from the spherical law of cosines, so
+ * no cell outside the footprint is ever tested.
+ */
+static void mark_footprint(worker *w, const double footprint[3]) {
+    const grid *g = w->b->g;
+    double ssp_lat = footprint[0], ssp_lon = footprint[1], cap = footprint[2];
+    if(!(cap > 0)) return;
+
+    int first_row = (int)floor((ssp_lat - cap + M_PI/2) / g->resolution);
+    int last_row = (int)floor((ssp_lat + cap + M_PI/2) / g->resolution);
+    if(first_row < w->first_row) first_row = w->first_row;
+    if(last_row > w->last_row) last_row = w->last_row;
+    if(first_row > last_row) return;
+    double cos_cap = cos(cap);
+    double sin_ssp_lat = sin(ssp_lat), cos_ssp_lat = cos(ssp_lat);
+
+    for(int row=first_row; row<=last_row; row++) {
+        double denominator = g->cos_lat[row] * cos_ssp_lat;
+        double cos_half_width = denominator > 1e-12 ?
+            (cos_cap - g->sin_lat[row] * sin_ssp_lat) / denominator : -2.0;
+        if(cos_half_width >= 1.0) continue;
+        if(cos_half_width <= -1.0) {
+            /* The cap contains a pole, or the sub-satellite point is at a pole */
+            if(denominator <= 1e-12 && g->sin_lat[row] * sin_ssp_lat < cos_cap) continue;
+            mark_cells(w, row, 0, g->nr_cols - 1);
+            continue;
+        }
+        double half_width = acos(cos_half_width);
+        /* The columns with their center between ssp_lon - half_width and
+           ssp_lon + half_width, which may wrap around the antimeridian */
+        long first_col = (long)ceil((ssp_lon - half_width + M_PI) / g->resolution - 0.5);
+        long last_col = (long)floor((ssp_lon + half_width + M_PI) / g->resolution - 0.5);
+        if(last_col < first_col) continue;
+        if(last_col - first_col + 1 >= g->nr_cols) {
+            mark_cells(w, row, 0, g->nr_cols - 1);
+        } else if(first_col < 0) {
+            mark_cells(w, row, 0, last_col);
+            mark_cells(w, row, first_col + g->nr_cols, g->nr_cols - 1);
+        } else if(last_col >= g->nr_cols) {
+            mark_cells(w, row, first_col, g->nr_cols - 1);
+            mark_cells(w, row, 0, last_col - g->nr_cols);
+        } else {
+            mark_cells(w, row, first_col, last_col);
+        }
+    }
+}
+
+static void *cover(void *arg) {
+    worker *w = arg;
+    batch *b = w->b;
+    size_t row_size = b->g->nr_cols;
+    for(size_t m=0; m<b->nr_moments; m++) {
+        const double *footprints = &b->p.states[m * b->p.nr_tles * 3];
+        w->first_marked = w->last_row + 1;
+        w->last_marked = w->first_row - 1;
+        for(size_t t=0; t<b->p.nr_tles; t++) mark_footprint(w, &footprints[t * 3]);
+        if(w->last_marked < w->first_marked) continue;
+        size_t nr_cells = (size_t)(w->last_marked - w->first_marked + 1) * row_size;
+        int *covered = b->covered + (size_t)w->first_marked * row_size;
+        unsigned char *visible = w->visible + (size_t)(w->first_marked - w->first_row) * row_size;
+        for(size_t cell=0; cell<nr_cells; cell++) covered[cell] += visible[cell];
+        memset(visible, 0, nr_cells);
+    }
+    return NULL;
+}
+
+static void free_workers(worker *workers, int nr_workers) {
+    for(int l=0; l<nr_workers; l++) free(workers[l].visible);
+    free(workers);
+}
+
+int main(int argc, char *argv[]) {
+    executable = argv[0];
+    struct option longopts[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'V' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "select", required_argument, NULL, 'S' },
+        { "min-elevation", required_argument, NULL, 'e' },
+        { "resolution", required_argument, NULL, 'r' },
+        { "start", required_argument, NULL, 's' },
+        { "end", required_argument, NULL, 'E' },
+        { "interval", required_argument, NULL, 'i' },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "format", required_argument, NULL, 'f' },
+        { "fields", required_argument, NULL, 'F' },
+        { "headers", no_argument, NULL, 'H' },
+        { NULL }
+    };
+
+    opterr = 0;
+    int c;
+    struct timeval now;
+    gettimeofday(&now, 0);
+    time_t start = now.tv_sec, end = 0;
+    int has_end = 0;
+    int interval = 60;
+    selection *sel = NULL;
+    int min_elevation = 0;
+    double resolution = 1.0;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nr_threads = nr_cpus > 1 ? (int)nr_cpus : 1;
+    char *selector = NULL;
+    int headers = 0;
+    output_format fmt = output_cols;
+
+    while((c = getopt_long(argc, argv, "hVvS:e:r:s:E:i:f:F:H", longopts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                exit(0);
+            case 'V':
+                printf("%s\n", VERSION);
+                exit(0);
+            case 'v':
+                debug_enable(1);
+                break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
+            case 'e':
+                if(optarg_as_int(&min_elevation, 0, 89))
+                    usage_error("Invalid elevation");
+                break;
+            case 'r':
+                if(arg_as_double_excl_excl(optarg, &resolution, 0.0, 180.0) ||
+                   fabs(180.0 / resolution - round(180.0 / resolution)) > 1e-9)
+                    usage_error("Invalid resolution");
+                break;
+            case 's':
+                if(optarg_as_datetime_extended(&start))
+                    usage_error("Invalid start");
+                break;
+            case 'E':
+                if(optarg_as_datetime_extended(&end))
+                    usage_error("Invalid end");
+                has_end = 1;
+                break;
+            case 'i':
+                if(optarg_as_int(&interval, 1, INT_MAX))
+                    usage_error("Invalid interval");
+                break;
+            case OPT_THREADS:
+                if(optarg_as_int(&nr_threads, 1, 1024))
+                    usage_error("Invalid number of threads");
+                break;
+            case 'f':
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
+                break;
+            case 'F':
+                if(check_selector(fields, optarg))
+                    usage_error("Invalid fields-string");
+                free(selector);
+                selector = strdup(optarg);
+                break;
+            case 'H':
+                headers = 1;
+                break;
+            default:
+                usage_error("Invalid option");
+                break;
+        }
+    }
+
+    char *file = NULL;
+    if(optind == argc-1) file = argv[argc-1];
+    else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
+    else usage_error("Supply a filename or set ORBIT_TOOLS_TLE");
+
+    if(!has_end) end = start + 24 * 3600;
+    if(end <= start) usage_error("The end must be after the start");
+
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to read file");
+    if(!cat->count) usage_error("No satellites found");
+
+    grid g;
+    g.resolution = deg_to_rad(resolution);
+    g.nr_rows = (int)round(180.0 / resolution);
+    g.nr_cols = 2 * g.nr_rows;
+    size_t nr_cells = (size_t)g.nr_rows * g.nr_cols;
+    g.sin_lat = malloc(g.nr_rows * sizeof(double));
+    g.cos_lat = malloc(g.nr_rows * sizeof(double));
+    if(!g.sin_lat || !g.cos_lat) usage_error("Out of memory");
+    for(int row=0; row<g.nr_rows; row++) {
+        double lat = -M_PI/2 + (row + 0.5) * g.resolution;
+        g.sin_lat[row] = sin(lat);
+        g.cos_lat[row] = cos(lat);
+    }
+
+    /* The moments are start, start + interval, ... up to but not including end */
+    long nr_moments = ((long)(end - start) + interval - 1) / interval;
+    size_t per_batch = BATCH_POSITIONS / cat->count;
+    if(per_batch < 1) per_batch = 1;
+    if(per_batch > nr_moments) per_batch = nr_moments;
+    if(nr_threads > g.nr_rows) nr_threads = g.nr_rows;
+
+    long *times = malloc(per_batch * sizeof(long));
+    double *rotations = malloc(per_batch * 2 * sizeof(double));
+    batch b = { &g, { cat->tles, cat->count, calloc(cat->count, 1), times, rotations, 0,
+                      malloc(per_batch * cat->count * 3 * sizeof(double)) },
+                cos(deg_to_rad(min_elevation)), deg_to_rad(min_elevation), 0,
+                calloc(nr_cells, sizeof(int)) };
+    worker *workers = calloc(nr_threads, sizeof(worker));
+    if(!times || !rotations || !b.p.failed || !b.p.states || !b.covered || !workers)
+        usage_error("Out of memory");
+    for(int l=0; l<nr_threads; l++) {
+        worker *w = &workers[l];
+        w->b = &b;
+        w->first_tle = cat->count * l / nr_threads;
+        w->last_tle = cat->count * (l+1) / nr_threads;
+        w->first_row = g.nr_rows * l / nr_threads;
+        w->last_row = g.nr_rows * (l+1) / nr_threads - 1;
+        w->visible = calloc((size_t)(w->last_row - w->first_row + 1) * g.nr_cols, 1);
+        if(!w->visible) {
+            free_workers(workers, nr_threads);
+            usage_error("Out of memory");
+        }
+    }
+    DEBUG("%zu satellites, %zu cells, %ld moments, %zu moments per batch, %d threads",
+          cat->count, nr_cells, nr_moments, per_batch, nr_threads);
+
+    for(long done=0; done<nr_moments; done+=b.nr_moments) {
+        b.nr_moments = nr_moments - done < per_batch ? nr_moments - done : per_batch;
+        for(size_t m=0; m<b.nr_moments; m++) {
+            times[m] = (start + (done + (long)m) * interval) * 1000L;
+            earth_rotation(times[m] / 1000.0, &rotations[2*m], &rotations[2*m+1]);
+        }
+        run_workers(workers, sizeof(worker), nr_threads, propagate);
+        run_workers(workers, sizeof(worker), nr_threads, cover);
+    }
+
+    report_sgp4_failures(b.p.failed, cat->count, "whose footprints are left out while it fails");
+
+    output_plan *plan = plan_output(fields, selector ? selector : "aoc", fmt);
+    plan->expected_rows = nr_cells;
+    if(fmt == output_cols && headers) render_headers(plan);
+    field_value values[sizeof fields / sizeof fields[0] - 1];
+    for(int row=0; row<g.nr_rows; row++) {
+        for(int col=0; col<g.nr_cols; col++) {
+            size_t cell = (size_t)row * g.nr_cols + col;
+            values[0].value.double_value = -90.0 + (row + 0.5) * resolution;
+            values[1].value.double_value = -180.0 + (col + 0.5) * resolution;
+            values[2].value.double_value = (double)b.covered[cell] / nr_moments;
+            values[3].value.int_value = b.covered[cell];
+            render(cell, plan, values);
+        }
+    }
+
+    close_output(plan);
+    free_workers(workers, nr_threads);
+    free(times);
+    free(rotations);
+    free(b.p.failed);
+    free(b.p.states);
+    free(b.covered);
+    free(g.sin_lat);
+    free(g.cos_lat);
+    unload_tles(cat);
+    free_selection(sel);
+    free(selector);
+    return 0;
+}
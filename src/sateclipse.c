@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <math.h>
+#include <sysexits.h>
+#include <getopt.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "opt_util.h"
+#include "tle_loader.h"
+#include "selection.h"
+#include "TLE.h"
+#include "sun.h"
+#include "util.h"
+#include "output.h"
+#include "version.h"
+#include "debug.h"
+#include "workers.h"
+
+static char *executable;
+
+static void usage(void) {
+    printf("Usage: %s [OPTION...] [<TLE-FILE>]\n", executable);
+    printf("\n");
+    printf("Finds the periods during which the satellites in <TLE-FILE> are in the\n");
+    printf("penumbra or umbra of the earth.\n");
+    printf("\n");
+    printf("<TLE-FILE> is a file containing one or more TLEs. Use\n");
+    printf("- to read the TLEs from stdin. If <TLE-FILE> is not supplied\n");
+    printf("then $ORBIT_TOOLS_TLE must be set to the filename to be used\n");
+    printf("\n");
+    printf("Options are:\n");
+    printf("-h,--help                 : Print this help and exit\n");
+    printf("-V,--version              : Print version and exit\n");
+    printf("-v,--verbose              : Print debug logging\n");
+    printf("-S,--select=<SELECTION>   : Only use the selected satellites from the TLE file.\n");
+    printf("                            <SELECTION> is a comma-separated list of names,\n");
+    printf("                            patterns like FLOCK*, catalog numbers and ranges of\n");
+    printf("                            catalog numbers like 40000-40100.\n");
+    printf("-s,--start=<START>        : The start of the period, specified as\n");
+    printf("                            yyyy-mm-ddThh:mm:ssZ or yyyy-mm-dd. The default is\n");
+    printf("                            the current date and time.\n");
+    printf("-E,--end=<END>            : The end of the period, specified like the start.\n");
+    printf("                            The default is one day after the start.\n");
+    printf("-i,--interval=<INTERVAL>  : The time between the moments at which the shadow is\n");
+    printf("                            determined, in seconds, at most 600. The default is\n");
+    printf("                            60.\n");
+    printf("   --sunlit               : Also print the periods in sunlight.\n");
+    printf("   --threads=<THREADS>    : The number of threads used. The default is the\n");
+    printf("                            number of CPUs.\n");
+    printf("-f,--format=rows|cols|csv|ndjson|binary|npy\n");
+    printf("                          : Sets the output format. The default is cols.\n");
+    printf("-H,--headers              : When the format is cols, first print a row with headers\n");
+    printf("-F,--fields=<FIELDS>      : Specifies the fields to include in the output.\n");
+    printf("                            <FIELDS> is a string consisting of:\n");
+    printf("                            n: The name of the satellite\n");
+    printf("                            c: The catalog number of the satellite\n");
+    printf("                            k: The kind of period: penumbra, umbra or sunlit\n");
+    printf("                            s: The start of the period, formatted\n");
+    printf("                            S: The start of the period, in seconds since the\n");
+    printf("                               epoch, with milliseconds\n");
+    printf("                            e: The end of the period, formatted\n");
+    printf("                            E: The end of the period, in seconds since the\n");
+    printf("                               epoch, with milliseconds\n");
+    printf("                            d: The duration of the period, in seconds\n");
+    printf("                            The default is nksed\n");
+    printf("\n");
+    printf("An eclipse consists of a period in the penumbra, one in the umbra when the\n");
+    printf("earth covers the sun completely, and another in the penumbra. The periods are\n");
+    printf("ordered by end, which is accurate to the millisecond. Periods in progress at\n");
+    printf("the start or end are cut off there, and periods in the umbra or penumbra that\n");
+    printf("are shorter than the interval may be missed.\n");
+}
+
+static void usage_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n\n%s --help for help\n", msg, executable);
+    exit(EX_USAGE);
+}
+
+#define OPT_THREADS (256)
+#define OPT_SUNLIT (257)
+
+static field fields[] = {
+    { "Satellite", "satellite", 'n', fld_type_string },
+    { "Catalog number", "catalog_number", 'c', fld_type_int },
+    { "Kind", "kind", 'k', fld_type_string },
+    { "Start", "start", 's', fld_type_time_ms_string },
+    { "Start", "start", 'S', fld_type_time_ms },
+    { "End", "end", 'e', fld_type_time_ms_string },
+    { "End", "end", 'E', fld_type_time_ms },
+    { "Duration", "duration", 'd', fld_type_double },
+    { NULL }
+};
+
+static const char *shadow_names[] = { "sunlit", "penumbra", "umbra" };
+
+/*
+ * The position of the sun is calculated once per moment for all satellites.
+ * Every satellite is propagated at every moment, and when its shadow differs
+ * from that at the previous moment, the time of every change in between is
+ * found by bisection. The shadow is assumed to go up or down at most once
+ * between two moments, which holds when the interval is shorter than the
+ * time spent in the umbra, apart from eclipses that only graze it.
+ */
+
+/* A batch contains at most this many moments */
+#define BATCH_MOMENTS (1440)
+
+typedef struct {
+    size_t tle;
+    shadow kind;
+    long start, end;            /* In milliseconds since 1970 */
+} period;
+
+typedef struct {
+    period *periods;
+    size_t count, size;
+} period_list;
+
+typedef struct {
+    TLE *tles;
+    size_t nr_sats;
+    int sunlit;                 /* Whether periods in sunlight are reported */
+    size_t nr_moments;          /* Not counting moment 0, the last moment of the previous batch */
+    size_t from;                /* The first moment to propagate, 0 for the first batch */
+    long *times;                /* For each moment, in milliseconds since 1970 */
+    double *sun;                /* sun[moment * 3], the position of the sun in ECI */
+    shadow *current;            /* For each satellite, the shadow it is in */
+    long *since;                /* For each satellite, when it entered the current shadow */
+    char *failed;               /* For each satellite, set when SGP4 failed */
+} batch;
+
+typedef struct {
+    batch *b;
+    size_t first, last;         /* The satellites to scan */
+    period_list periods;
+    int out_of_memory;
+} worker;
+
+static int add_period(period_list *list, const period *p) {
+    if(list->count == list->size) {
+        size_t size = list->size ? list->size * 2 : 64;
+        period *periods = realloc(list->periods, size * sizeof(period));
+        if(!periods) return -1;
+        list->periods = periods;
+        list->size = size;
+    }
+    list->periods[list->count++] = *p;
+    return 0;
+}
+
+static int compare_periods(const void *a, const void *b) {
+    const period *pa = a, *pb = b;
+    if(pa->end != pb->end) return pa->end < pb->end ? -1 : 1;
+    return pa->tle < pb->tle ? -1 : pa->tle > pb->tle;
+}
+
+/* Finds the first time after lo, up to hi, at which the satellite has gone
+   from shadow from into shadow to. Returns hi when SGP4 fails */
+static long find_change(TLE *tle, long lo, long hi, shadow from, shadow to) {
+    while(hi - lo > 1) {
+        long mid = lo + (hi - lo) / 2;
+        double r[3], v[3], sun[3];
+        getRVForDate(tle, mid, r, v);
+        if(tle->sgp4Error) break;
+        sun_position(mid, sun);
+        shadow kind = get_shadow(r, sun);
+        if(to > from ? kind >= to : kind <= to) hi = mid;
+        else lo = mid;
+    }
+    return hi;
+}
+
+/* Ends the period of satellite s in its current shadow at the given time */
+static int end_period(worker *w, size_t s, long when) {
+    batch *b = w->b;
+    if(when <= b->since[s] || (b->current[s] == shadow_none && !b->sunlit)) return 0;
+    period p = { s, b->current[s], b->since[s], when };
+    return add_period(&w->periods, &p);
+}
+
+static void *scan(void *arg) {
+    worker *w = arg;
+    batch *b = w->b;
+    w->periods.count = 0;
+    for(size_t s=w->first; s<w->last && !w->out_of_memory; s++) {
+        TLE *tle = &b->tles[s];
+        for(size_t m=b->from; m<=b->nr_moments && !b->failed[s] && !w->out_of_memory; m++) {
+            double r[3], v[3];
+            getRVForDate(tle, b->times[m], r, v);
+            if(tle->sgp4Error) {
+                b->failed[s] = 1;
+                break;
+            }
+            shadow kind = get_shadow(r, &b->sun[m * 3]);
+            if(!m) {
+                b->current[s] = kind;
+                b->since[s] = b->times[0];
+                continue;
+            }
+            while(kind != b->current[s]) {
+                shadow next = kind > b->current[s] ? b->current[s] + 1 : b->current[s] - 1;
+                long lo = b->since[s] > b->times[m-1] ? b->since[s] : b->times[m-1];
+                long when = find_change(tle, lo, b->times[m], b->current[s], next);
+                if(end_period(w, s, when)) {
+                    w->out_of_memory = 1;
+                    break;
+                }
+                b->current[s] = next;
+                b->since[s] = when;
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    executable = argv[0];
+    struct option longopts[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'V' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "select", required_argument, NULL, 'S' },
+        { "start", required_argument, NULL, 's' },
+        { "end", required_argument, NULL, 'E' },
+        { "interval", required_argument, NULL, 'i' },
+        { "sunlit", no_argument, NULL, OPT_SUNLIT },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "format", required_argument, NULL, 'f' },
+        { "fields", required_argument, NULL, 'F' },
+        { "headers", no_argument, NULL, 'H' },
+        { NULL }
+    };
+
+    opterr = 0;
+    int c;
+    struct timeval now;
+    gettimeofday(&now, 0);
+    time_t start = now.tv_sec, end = 0;
+    int has_end = 0;
+    int interval = 60;
+    int sunlit = 0;
+    selection *sel = NULL;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nr_threads = nr_cpus > 1 ? (int)nr_cpus : 1;
+    char *selector = NULL;
+    int headers = 0;
+    output_format fmt = output_cols;
+
+    while((c = getopt_long(argc, argv, "hVvS:s:E:i:f:F:H", longopts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                exit(0);
+            case 'V':
+                printf("%s\n", VERSION);
+                exit(0);
+            case 'v':
+                debug_enable(1);
+                break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
+            case 's':
+                if(optarg_as_datetime_extended(&start))
+                    usage_error("Invalid start");
+                break;
+            case 'E':
+                if(optarg_as_datetime_extended(&end))
+                    usage_error("Invalid end");
+                has_end = 1;
+                break;
+            case 'i':
+                if(optarg_as_int(&interval, 1, 600))
+                    usage_error("Invalid interval");
+                break;
+            case OPT_SUNLIT:
+                sunlit = 1;
+                break;
+            case OPT_THREADS:
+                if(optarg_as_int(&nr_threads, 1, 1024))
+                    usage_error("Invalid number of threads");
+                break;
+            case 'f':
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
+                break;
+            case 'F':
+                if(check_selector(fields, optarg))
+                    usage_error("Invalid fields-string");
+                free(selector);
+                selector = strdup(optarg);
+                break;
+            case 'H':
+                headers = 1;
+                break;
+            default:
+                usage_error("Invalid option");
+                break;
+        }
+    }
+
+    char *file = NULL;
+    if(optind == argc-1) file = argv[argc-1];
+    else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
+    else usage_error("Supply a filename or set ORBIT_TOOLS_TLE");
+
+    if(!has_end) end = start + 24 * 3600;
+    if(end <= start) usage_error("The end must be after the start");
+
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to read file");
+    if(!cat->count) usage_error("No satellites found");
+    size_t nr_sats = cat->count;
+
+    /* Moment k is at start + k * interval, and the last at the end */
+    long interval_ms = interval * 1000L;
+    size_t nr_intervals = (end - start + interval - 1) / interval;
+
+    batch b = { cat->tles, nr_sats, sunlit };
+    b.times = malloc((BATCH_MOMENTS + 1) * sizeof(long));
+    b.sun = malloc((BATCH_MOMENTS + 1) * 3 * sizeof(double));
+    b.current = malloc(nr_sats * sizeof(shadow));
+    b.since = malloc(nr_sats * sizeof(long));
+    b.failed = calloc(nr_sats, 1);
+    if(nr_threads > nr_sats) nr_threads = nr_sats;
+    worker *workers = calloc(nr_threads, sizeof(worker));
+    if(!b.times || !b.sun || !b.current || !b.since || !b.failed || !workers)
+        usage_error("Out of memory");
+    for(int l=0; l<nr_threads; l++) {
+        workers[l].b = &b;
+        workers[l].first = nr_sats * l / nr_threads;
+        workers[l].last = nr_sats * (l+1) / nr_threads;
+    }
+
+    output_plan *plan = plan_output(fields, selector ? selector : "nksed", fmt);
+    if(fmt == output_cols && headers) render_headers(plan);
+    field_value values[sizeof fields / sizeof fields[0] - 1];
+    int rendered = 0;
+    int result = 0;
+    period_list list = { NULL, 0, 0 };
+
+    for(size_t done=0; done<nr_intervals && !result; done+=b.nr_moments) {
+        b.nr_moments = nr_intervals - done < BATCH_MOMENTS ? nr_intervals - done : BATCH_MOMENTS;
+        for(size_t m=b.from; m<=b.nr_moments; m++) {
+            long when = start * 1000L + (long)(done + m) * interval_ms;
+            b.times[m] = when < end * 1000L ? when : end * 1000L;
+            sun_position(b.times[m], &b.sun[m * 3]);
+        }
+        run_workers(workers, sizeof(worker), nr_threads, scan);
+
+        list.count = 0;
+        for(int l=0; l<nr_threads && !result; l++) {
+            if(workers[l].out_of_memory) result = EX_OSERR;
+            for(size_t p=0; p<workers[l].periods.count && !result; p++)
+                if(add_period(&list, &workers[l].periods.periods[p])) result = EX_OSERR;
+        }
+        /* At the end, the periods in progress are cut off */
+        if(!result && done + b.nr_moments == nr_intervals) {
+            for(size_t s=0; s<nr_sats && !result; s++) {
+                if(b.failed[s] || (b.current[s] == shadow_none && !sunlit) || b.since[s] >= end * 1000L)
+                    continue;
+                period p = { s, b.current[s], b.since[s], end * 1000L };
+                if(add_period(&list, &p)) result = EX_OSERR;
+            }
+        }
+        if(result) {
+            fprintf(stderr, "Error: out of memory\n");
+            break;
+        }
+        if(list.count) qsort(list.periods, list.count, sizeof(period), compare_periods);
+        for(size_t p=0; p<list.count; p++) {
+            const period *pe = &list.periods[p];
+            values[0].value.string_value = cat->names[pe->tle] ? cat->names[pe->tle] : "unknown";
+            values[1].value.int_value = cat->catalog_numbers[pe->tle];
+            values[2].value.string_value = shadow_names[pe->kind];
+            values[3].value.time_ms_value = pe->start;
+            values[4].value.time_ms_value = pe->start;
+            values[5].value.time_ms_value = pe->end;
+            values[6].value.time_ms_value = pe->end;
+            values[7].value.double_value = (pe->end - pe->start) / 1000.0;
+            render(rendered++, plan, values);
+        }
+
+        /* The last moment of this batch is the first of the next */
+        b.times[0] = b.times[b.nr_moments];
+        memcpy(b.sun, &b.sun[b.nr_moments * 3], 3 * sizeof(double));
+        b.from = 1;
+    }
+    DEBUG("%d periods", rendered);
+
+    report_sgp4_failures(b.failed, nr_sats, "whose periods are left out from the first failure on");
+
+    close_output(plan);
+    free(list.periods);
+    for(int l=0; l<nr_threads; l++) free(workers[l].periods.periods);
+    free(workers);
+    free(b.times);
+    free(b.sun);
+    free(b.current);
+    free(b.since);
+    free(b.failed);
+    unload_tles(cat);
+    free_selection(sel);
+    free(selector);
+    return result;
+}
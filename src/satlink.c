@@ -0,0 +1,535 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <math.h>
+#include <sysexits.h>
+#include <getopt.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "opt_util.h"
+#include "tle_loader.h"
+#include "selection.h"
+#include "TLE.h"
+#include "util.h"
+#include "output.h"
+#include "constants.h"
+#include "version.h"
+#include "debug.h"
+#include "workers.h"
+
+static char *executable;
+
+static void usage(void) {
+    printf("Usage: %s [OPTION...] [<TLE-FILE>]\n", executable);
+    printf("\n");
+    printf("Finds the times at which the line of sight between two satellites in <TLE-FILE>\n");
+    printf("is established or lost: when it starts or stops passing above the grazing\n");
+    printf("altitude, or when the satellites come within or get beyond the maximum range.\n");
+    printf("\n");
+    printf("<TLE-FILE> is a file containing one or more TLEs. Use\n");
+    printf("- to read the TLEs from stdin. If <TLE-FILE> is not supplied\n");
+    printf("then $ORBIT_TOOLS_TLE must be set to the filename to be used\n");
+    printf("\n");
+    printf("Options are:\n");
+    printf("-h,--help                 : Print this help and exit\n");
+    printf("-V,--version              : Print version and exit\n");
+    printf("-v,--verbose              : Print debug logging\n");
+    printf("-S,--select=<SELECTION>   : Only use the selected satellites from the TLE file.\n");
+    printf("                            <SELECTION> is a comma-separated list of names,\n");
+    printf("                            patterns like FLOCK*, catalog numbers and ranges of\n");
+    printf("                            catalog numbers like 40000-40100.\n");
+    printf("-P,--primary=<SELECTION>  : Only find the links of the satellites in\n");
+    printf("                            <SELECTION>, formatted like for --select, with each\n");
+    printf("                            other and with all other satellites. The default is\n");
+    printf("                            to find the links between all satellites.\n");
+    printf("-g,--grazing-altitude=<ALTITUDE>\n");
+    printf("                          : The lowest altitude above the earth of a line of\n");
+    printf("                            sight, in km. The default is 100.\n");
+    printf("-r,--max-range=<RANGE>    : The largest distance between two linked satellites,\n");
+    printf("                            in km. The default is no limit.\n");
+    printf("-s,--start=<START>        : The start of the period, specified as\n");
+    printf("                            yyyy-mm-ddThh:mm:ssZ or yyyy-mm-dd. The default is\n");
+    printf("                            the current date and time.\n");
+    printf("-E,--end=<END>            : The end of the period, specified like the start.\n");
+    printf("                            The default is one day after the start.\n");
+    printf("-i,--interval=<INTERVAL>  : The time between the moments at which the links are\n");
+    printf("                            checked, in seconds, at most 60. The default is 10.\n");
+    printf("   --threads=<THREADS>    : The number of threads used. The default is the\n");
+    printf("                            number of CPUs.\n");
+    printf("-f,--format=rows|cols|csv|ndjson|binary|npy\n");
+    printf("                          : Sets the output format. The default is cols.\n");
+    printf("-H,--headers              : When the format is cols, first print a row with headers\n");
+    printf("-F,--fields=<FIELDS>      : Specifies the fields to include in the output.\n");
+    printf("                            <FIELDS> is a string consisting of:\n");
+    printf("                            t: The time of the event, formatted\n");
+    printf("                            T: The time of the event, in seconds since the\n");
+    printf("                               epoch, with milliseconds\n");
+    printf("                            n: The name of the (primary) satellite\n");
+    printf("                            c: The catalog number of the (primary) satellite\n");
+    printf("                            N: The name of the other satellite\n");
+    printf("                            C: The catalog number of the other satellite\n");
+    printf("                            e: The event, up or down\n");
+    printf("                            r: The distance between the satellites, in km\n");
+    printf("                            The default is tnNer\n");
+    printf("\n");
+    printf("The links that are up at the start are reported as going up at the start. The\n");
+    printf("events are ordered by time, which is accurate to a few milliseconds. Links\n");
+    printf("that are up or down for less than the interval may be missed.\n");
+}
+
+static void usage_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n\n%s --help for help\n", msg, executable);
+    exit(EX_USAGE);
+}
+
+#define OPT_THREADS (256)
+
+static field fields[] = {
+    { "Time", "time", 't', fld_type_time_ms_string },
+    { "Time", "time", 'T', fld_type_time_ms },
+    { "Satellite", "satellite", 'n', fld_type_string },
+    { "Catalog number", "catalog_number", 'c', fld_type_int },
+    { "Other satellite", "other_satellite", 'N', fld_type_string },
+    { "Other catalog number", "other_catalog_number", 'C', fld_type_int },
+    { "Event", "event", 'e', fld_type_string },
+    { "Range", "range", 'r', fld_type_double },
+    { NULL }
+};
+
+/*
+ * At every moment, all satellites are propagated once, after which the line
+ * of sight of every pair is checked. The positions are kept as separate
+ * arrays of x, y and z, so that the check of all pairs of one satellite is a
+ * loop without branches over those arrays. Only when the state of a link
+ * differs from that at the previous moment, the time of the change is found
+ * by bisection, on positions interpolated between the two moments from the
+ * positions and velocities at both.
+ */
+
+/* A batch contains at most this many positions and velocities */
+#define BATCH_STATES (65536)
+
+typedef struct {
+    size_t tle;
+    int catalog_number;
+} object;
+
+typedef struct {
+    long when;                  /* In milliseconds since 1970 */
+    size_t first, second;       /* Indexes in the catalog */
+    int up;
+    double range;
+} event;
+
+typedef struct {
+    event *events;
+    size_t count, size;
+} event_list;
+
+/*
+ * The objects are ordered with the primaries first, and the TLEs of the
+ * propagation are copies of theirs, in the same order. The links of primary p
+ * with the objects after it are at links[row_offset(p) ...], one byte for
+ * each, set while the link is up.
+ */
+typedef struct {
+    propagation p;              /* In ECI, with velocities */
+    const object *objects;
+    size_t nr_objects, nr_primaries;
+    double min_radius_sq, max_range_sq;
+    size_t nr_moments;          /* Not counting moment 0, the last moment of the previous batch */
+    size_t from;                /* The first moment to propagate and check, 0 for the first batch */
+    double *x, *y, *z;          /* x[moment * nr_objects + object] */
+    unsigned char *links;
+} batch;
+
+typedef struct {
+    batch *b;
+    size_t first, last;         /* The objects to propagate */
+    size_t row;                 /* The rows row, row + nr_rows, ... are checked */
+    size_t nr_rows;
+    unsigned char *up;
+    event_list events;
+    int out_of_memory;
+} worker;
+
+static size_t row_offset(size_t row, size_t nr_objects) {
+    return row * (2 * nr_objects - row - 1) / 2;
+}
+
+static void *propagate(void *arg) {
+    worker *w = arg;
+    batch *b = w->b;
+    size_t n = b->nr_objects;
+    propagate_tles(&b->p, w->first, w->last, b->from, b->nr_moments + 1);
+    for(size_t o=w->first; o<w->last; o++) {
+        for(size_t m=b->from; m<=b->nr_moments; m++) {
+            const double *state = &b->p.states[(m * n + o) * 6];
+            b->x[m * n + o] = state[0];
+            b->y[m * n + o] = state[1];
+            b->z[m * n + o] = state[2];
+        }
+    }
+    return NULL;
+}
+
+/* Sets up[j] for every object j after object i to whether it has a line of
+   sight with object i */
+static void check_row(const batch *b, size_t moment, size_t i, unsigned char *up) {
+    size_t n = b->nr_objects;
+    const double *x = &b->x[moment * n], *y = &b->y[moment * n], *z = &b->z[moment * n];
+    double ax = x[i], ay = y[i], az = z[i];
+    double aa = ax * ax + ay * ay + az * az;
+    double min_radius_sq = b->min_radius_sq, max_range_sq = b->max_range_sq;
+    for(size_t j=i+1; j<n; j++) {
+        double dx = x[j] - ax, dy = y[j] - ay, dz = z[j] - az;
+        double dd = dx * dx + dy * dy + dz * dz;
+        double ad = ax * dx + ay * dy + az * dz;
+        double bb = x[j] * x[j] + y[j] * y[j] + z[j] * z[j];
+        /* The squared distance from the center of the earth to the closest
+           point of the line of sight. Any NAN makes the link down */
+        double closest = ad >= 0 ? aa : -ad >= dd ? bb : aa - ad * ad / dd;
+        up[j] = closest > min_radius_sq && dd <= max_range_sq;
+    }
+}
+
+/* Like check_row, for a single pair of positions, also setting the range */
+static int has_line_of_sight(const batch *b, const double a[3], const double other[3], double *range) {
+    double d[3];
+    vec3_sub(other, a, d);
+    double dd = dot_product(d, d), ad = dot_product(a, d);
+    double closest = ad >= 0 ? dot_product(a, a) : -ad >= dd ? dot_product(other, other) :
+                     dot_product(a, a) - ad * ad / dd;
+    *range = sqrt(dd);
+    return closest > b->min_radius_sq && dd <= b->max_range_sq;
+}
+
+/* The position at when between the states at t0 and t1, by cubic Hermite
+   interpolation */
+static void interpolate(const double *state0, const double *state1, long t0, long t1, long when,
+                        double position[3]) {
+    double h = (t1 - t0) / 1000.0;
+    double s = (double)(when - t0) / (t1 - t0);
+    double h00 = (1 + 2 * s) * (1 - s) * (1 - s), h10 = s * (1 - s) * (1 - s);
+    double h01 = s * s * (3 - 2 * s), h11 = s * s * (s - 1);
+    for(int l=0; l<3; l++)
+        position[l] = h00 * state0[l] + h10 * h * state0[l+3] + h01 * state1[l] + h11 * h * state1[l+3];
+}
+
+/* Finds the time at which the link between objects i and j changes to up,
+   between the previous moment and the given one, and sets the range then */
+static long find_change(const batch *b, size_t moment, size_t i, size_t j, int up, double *range) {
+    size_t n = b->nr_objects;
+    const double *i0 = &b->p.states[((moment - 1) * n + i) * 6], *i1 = &b->p.states[(moment * n + i) * 6];
+    const double *j0 = &b->p.states[((moment - 1) * n + j) * 6], *j1 = &b->p.states[(moment * n + j) * 6];
+    long t0 = b->p.times[moment - 1], t1 = b->p.times[moment];
+    long lo = t0, hi = t1;
+    double a[3], other[3];
+    while(hi - lo > 1) {
+        long mid = lo + (hi - lo) / 2;
+        interpolate(i0, i1, t0, t1, mid, a);
+        interpolate(j0, j1, t0, t1, mid, other);
+        if(has_line_of_sight(b, a, other, range) == up) hi = mid;
+        else lo = mid;
+    }
+    interpolate(i0, i1, t0, t1, hi, a);
+    interpolate(j0, j1, t0, t1, hi, other);
+    has_line_of_sight(b, a, other, range);
+    return hi;
+}
+
+static int add_event(event_list *list, const event *e) {
+    if(list->count == list->size) {
+        size_t size = list->size ? list->size * 2 : 64;
+        event *events = realloc(list->events, size * sizeof(event));
+        if(!events) return -1;
+        list->events = events;
+        list->size = size;
+    }
+    list->events[list->count++] = *e;
+    return 0;
+}
+
+static int compare_events(const void *a, const void *b) {
+    const event *ea = a, *eb = b;
+    if(ea->when != eb->when) return ea->when < eb->when ? -1 : 1;
+    if(ea->first != eb->first) return ea->first < eb->first ? -1 : 1;
+    return ea->second < eb->second ? -1 : ea->second > eb->second;
+}
+
+static void *find_events(void *arg) {
+    worker *w = arg;
+    batch *b = w->b;
+    size_t n = b->nr_objects;
+    w->events.count = 0;
+    for(size_t m=b->from; m<=b->nr_moments && !w->out_of_memory; m++) {
+        for(size_t i=w->row; i<b->nr_primaries; i+=w->nr_rows) {
+            check_row(b, m, i, w->up);
+            unsigned char *links = &b->links[row_offset(i, n)];
+            for(size_t j=i+1; j<n; j++) {
+                if(w->up[j] == links[j-i-1]) continue;
+                /* Multiple TLEs of the same satellite are not linked */
+                if(b->objects[i].catalog_number >= 0 &&
+                   b->objects[i].catalog_number == b->objects[j].catalog_number)
+                    continue;
+                links[j-i-1] = w->up[j];
+                event e;
+                e.first = b->objects[i].tle;
+                e.second = b->objects[j].tle;
+                e.up = w->up[j];
+                if(m) {
+                    e.when = find_change(b, m, i, j, e.up, &e.range);
+                } else {
+                    e.when = b->p.times[0];
+                    has_line_of_sight(b, &b->p.states[i * 6], &b->p.states[j * 6], &e.range);
+                }
+                if(add_event(&w->events, &e)) {
+                    w->out_of_memory = 1;
+                    break;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    executable = argv[0];
+    struct option longopts[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'V' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "select", required_argument, NULL, 'S' },
+        { "primary", required_argument, NULL, 'P' },
+        { "grazing-altitude", required_argument, NULL, 'g' },
+        { "max-range", required_argument, NULL, 'r' },
+        { "start", required_argument, NULL, 's' },
+        { "end", required_argument, NULL, 'E' },
+        { "interval", required_argument, NULL, 'i' },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "format", required_argument, NULL, 'f' },
+        { "fields", required_argument, NULL, 'F' },
+        { "headers", no_argument, NULL, 'H' },
+        { NULL }
+    };
+
+    opterr = 0;
+    int c;
+    struct timeval now;
+    gettimeofday(&now, 0);
+    time_t start = now.tv_sec, end = 0;
+    int has_end = 0;
+    int interval = 10;
+    double grazing_altitude = 100, max_range = INFINITY;
+    selection *sel = NULL, *primary = NULL;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nr_threads = nr_cpus > 1 ? (int)nr_cpus : 1;
+    char *selector = NULL;
+    int headers = 0;
+    output_format fmt = output_cols;
+
+    while((c = getopt_long(argc, argv, "hVvS:P:g:r:s:E:i:f:F:H", longopts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                exit(0);
+            case 'V':
+                printf("%s\n", VERSION);
+                exit(0);
+            case 'v':
+                debug_enable(1);
+                break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
+            case 'P':
+                free_selection(primary);
+                if(!(primary = parse_selection(optarg)))
+                    usage_error("Invalid primary selection");
+                break;
+            case 'g':
+                if(arg_as_double_incl_excl(optarg, &grazing_altitude, -WGS84_A, 100000))
+                    usage_error("Invalid grazing altitude");
+                break;
+            case 'r':
+                if(arg_as_double_excl_excl(optarg, &max_range, 0, 1000000))
+                    usage_error("Invalid maximum range");
+                break;
+            case 's':
+                if(optarg_as_datetime_extended(&start))
+                    usage_error("Invalid start");
+                break;
+            case 'E':
+                if(optarg_as_datetime_extended(&end))
+                    usage_error("Invalid end");
+                has_end = 1;
+                break;
+            case 'i':
+                if(optarg_as_int(&interval, 1, 60))
+                    usage_error("Invalid interval");
+                break;
+            case OPT_THREADS:
+                if(optarg_as_int(&nr_threads, 1, 1024))
+                    usage_error("Invalid number of threads");
+                break;
+            case 'f':
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
+                break;
+            case 'F':
+                if(check_selector(fields, optarg))
+                    usage_error("Invalid fields-string");
+                free(selector);
+                selector = strdup(optarg);
+                break;
+            case 'H':
+                headers = 1;
+                break;
+            default:
+                usage_error("Invalid option");
+                break;
+        }
+    }
+
+    char *file = NULL;
+    if(optind == argc-1) file = argv[argc-1];
+    else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
+    else usage_error("Supply a filename or set ORBIT_TOOLS_TLE");
+
+    if(!has_end) end = start + 24 * 3600;
+    if(end <= start) usage_error("The end must be after the start");
+
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to read file");
+    if(!cat->count) usage_error("No satellites found");
+
+    /* The primaries come first */
+    size_t nr_objects = cat->count, nr_primaries = 0;
+    object *objects = malloc(nr_objects * sizeof(object));
+    if(!objects) usage_error("Out of memory");
+    size_t nr_others = 0;
+    for(size_t t=0; t<cat->count; t++)
+        nr_primaries += !primary || is_selected(primary, cat->names[t], cat->catalog_numbers[t]);
+    if(!nr_primaries) usage_error("No primary satellites found");
+    for(size_t t=0, p=0; t<cat->count; t++) {
+        int is_primary = !primary || is_selected(primary, cat->names[t], cat->catalog_numbers[t]);
+        object *o = is_primary ? &objects[p++] : &objects[nr_primaries + nr_others++];
+        o->tle = t;
+        o->catalog_number = cat->catalog_numbers[t];
+    }
+    DEBUG("%zu satellites, %zu primaries", nr_objects, nr_primaries);
+
+    /* Moment k is at start + k * interval, and the last at the end */
+    long interval_ms = interval * 1000L;
+    size_t nr_intervals = (end - start + interval - 1) / interval;
+    size_t per_batch = BATCH_STATES / nr_objects;
+    if(per_batch < 2) per_batch = 2;
+    per_batch--;
+    if(per_batch > nr_intervals) per_batch = nr_intervals;
+
+    TLE *tles = malloc(nr_objects * sizeof(TLE));
+    long *times = malloc((per_batch + 1) * sizeof(long));
+    batch b = { { tles, nr_objects, calloc(nr_objects, 1), times, NULL, 1,
+                  malloc((per_batch + 1) * nr_objects * 6 * sizeof(double)) },
+                objects, nr_objects, nr_primaries };
+    double min_radius = WGS84_A + grazing_altitude;
+    b.min_radius_sq = min_radius > 0 ? min_radius * min_radius : 0;
+    b.max_range_sq = max_range * max_range;
+    b.x = malloc((per_batch + 1) * nr_objects * sizeof(double));
+    b.y = malloc((per_batch + 1) * nr_objects * sizeof(double));
+    b.z = malloc((per_batch + 1) * nr_objects * sizeof(double));
+    b.links = calloc(row_offset(nr_primaries, nr_objects) + 1, 1);
+    if(nr_threads > nr_objects) nr_threads = nr_objects;
+    worker *workers = calloc(nr_threads, sizeof(worker));
+    if(!tles || !times || !b.p.failed || !b.p.states || !b.x || !b.y || !b.z || !b.links || !workers)
+        usage_error("Out of memory");
+    for(size_t o=0; o<nr_objects; o++) tles[o] = cat->tles[objects[o].tle];
+    for(int l=0; l<nr_threads; l++) {
+        workers[l].b = &b;
+        workers[l].first = nr_objects * l / nr_threads;
+        workers[l].last = nr_objects * (l+1) / nr_threads;
+        workers[l].row = l;
+        workers[l].nr_rows = nr_threads;
+        if(!(workers[l].up = malloc(nr_objects)))
+            usage_error("Out of memory");
+    }
+
+    output_plan *plan = plan_output(fields, selector ? selector : "tnNer", fmt);
+    if(fmt == output_cols && headers) render_headers(plan);
+    field_value values[sizeof fields / sizeof fields[0] - 1];
+    int rendered = 0;
+    int result = 0;
+    event_list list = { NULL, 0, 0 };
+    long nr_events = 0;
+
+    for(size_t done=0; done<nr_intervals && !result; done+=b.nr_moments) {
+        b.nr_moments = nr_intervals - done < per_batch ? nr_intervals - done : per_batch;
+        for(size_t m=0; m<=b.nr_moments; m++) {
+            long when = start * 1000L + (long)(done + m) * interval_ms;
+            times[m] = when < end * 1000L ? when : end * 1000L;
+        }
+        run_workers(workers, sizeof(worker), nr_threads, propagate);
+        run_workers(workers, sizeof(worker), nr_threads, find_events);
+
+        list.count = 0;
+        for(int l=0; l<nr_threads && !result; l++) {
+            if(workers[l].out_of_memory) result = EX_OSERR;
+            for(size_t e=0; e<workers[l].events.count && !result; e++)
+                if(add_event(&list, &workers[l].events.events[e])) result = EX_OSERR;
+        }
+        if(result) {
+            fprintf(stderr, "Error: out of memory\n");
+            break;
+        }
+        if(list.count) qsort(list.events, list.count, sizeof(event), compare_events);
+        for(size_t e=0; e<list.count; e++) {
+            const event *ev = &list.events[e];
+            values[0].value.time_ms_value = ev->when;
+            values[1].value.time_ms_value = ev->when;
+            values[2].value.string_value = cat->names[ev->first] ? cat->names[ev->first] : "unknown";
+            values[3].value.int_value = cat->catalog_numbers[ev->first];
+            values[4].value.string_value = cat->names[ev->second] ? cat->names[ev->second] : "unknown";
+            values[5].value.int_value = cat->catalog_numbers[ev->second];
+            values[6].value.string_value = ev->up ? "up" : "down";
+            values[7].value.double_value = ev->range;
+            render(rendered++, plan, values);
+        }
+        nr_events += list.count;
+
+        /* The last moment of this batch is the first of the next */
+        memcpy(b.p.states, &b.p.states[b.nr_moments * nr_objects * 6], nr_objects * 6 * sizeof(double));
+        memcpy(b.x, &b.x[b.nr_moments * nr_objects], nr_objects * sizeof(double));
+        memcpy(b.y, &b.y[b.nr_moments * nr_objects], nr_objects * sizeof(double));
+        memcpy(b.z, &b.z[b.nr_moments * nr_objects], nr_objects * sizeof(double));
+        b.from = 1;
+    }
+    DEBUG("%ld events", nr_events);
+
+    report_sgp4_failures(b.p.failed, nr_objects, "whose links are down while it fails");
+
+    close_output(plan);
+    free(list.events);
+    for(int l=0; l<nr_threads; l++) {
+        free(workers[l].up);
+        free(workers[l].events.events);
+    }
+    free(workers);
+    free(b.p.failed);
+    free(b.p.states);
+    free(tles);
+    free(times);
+    free(b.x);
+    free(b.y);
+    free(b.z);
+    free(b.links);
+    free(objects);
+    unload_tles(cat);
+    free_selection(sel);
+    free_selection(primary);
+    free(selector);
+    return result;
+}
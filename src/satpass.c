@@ -1,14 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sysexits.h>
 #include <getopt.h>
 #include <string.h>
 #include <limits.h>
+#include <math.h>
 #include "opt_util.h"
 #include "tle_loader.h"
+#include "selection.h"
 #include "TLE.h"
 #include "observer.h"
+#include "sun.h"
 #include "util.h"
 #include "output.h"
 #include "version.h"
@@ -30,6 +34,10 @@ static void usage(void) {
     printf("-n,--satellite-name=<NAME>     : Find passes for the named satellite. When\n");
     printf("                                 not specified, find passes for all satellites\n");
     printf("                                 in the TLE file.\n");
+    printf("-S,--select=<SELECTION>        : Only load the selected satellites from the TLE\n");
+    printf("                                 file. <SELECTION> is a comma-separated list of\n");
+    printf("                                 names, patterns like FLOCK*, catalog numbers and\n");
+    printf("                                 ranges of catalog numbers like 40000-40100.\n");
     printf("-e,--min-elevation=<ELEVATION> : Find only passes with a best elevation of at\n");
     printf("                                 least <ELEVATION> degrees. The default is 0.\n");
     printf("-c,--count=<COUNT>             : Stop after finding <COUNT> passes. The default\n");
@@ -44,8 +52,10 @@ static void usage(void) {
     printf("                                 specified as yyyy-mm-ddThh:mm:ssZ. By default, there\n");
     printf("                                 is no end-date, and the number of passes is determined\n");
     printf("                                 but the --count option.\n");
-    printf("-f,--format=rows|cols          : Sets the output format. When not specified, rows\n");
-    printf("                                 is used when count is 1, otherwise cols\n");
+    printf("-f,--format=rows|cols|csv|ndjson|binary|npy\n");
+    printf("                               : Sets the output format. When not specified, rows\n");
+    printf("                                 is used when count is 1, otherwise cols. binary\n");
+    printf("                                 and npy write fixed-size records, see README.md\n");
     printf("-F,--fields=<FIELDS>           : Specifies the fields to include in the output.\n");
     printf("                                 <FIELDS> is a string consisting of:\n");
     printf("                                 s: The pass start time, formatted\n");
@@ -60,7 +70,47 @@ static void usage(void) {
     printf("                                 z: The azimuth when the elevation is the highest\n");
     printf("                                 Z: The azimuth at the start of the pass\n");
     printf("                                 Y: The azimuth at the end of the pass\n");
-    printf("                                 The default is ndstel\n");
+    printf("                                 u: The range rate at the start of the pass, in km/s\n");
+    printf("                                 v: The range rate at the time of closest approach\n");
+    printf("                                 w: The range rate at the end of the pass\n");
+    printf("                                 U: With --doppler, the Doppler rate at the start of\n");
+    printf("                                    the pass, in Hz/s\n");
+    printf("                                 V: With --doppler, the Doppler rate at the time of\n");
+    printf("                                    closest approach\n");
+    printf("                                 W: With --doppler, the Doppler rate at the end of\n");
+    printf("                                    the pass\n");
+    printf("                                 b: With --doppler, the segment start time, formatted\n");
+    printf("                                 B: With --doppler, the segment start time, in seconds\n");
+    printf("                                    since the epoch\n");
+    printf("                                 f: With --doppler, the segment end time, formatted\n");
+    printf("                                 F: With --doppler, the segment end time, in seconds\n");
+    printf("                                    since the epoch\n");
+    printf("                                 0-9: With --doppler, the Chebyshev coefficients of\n");
+    printf("                                    the fit of the Doppler shift in Hz: the shift is\n");
+    printf("                                    0 + 1 T1(x) + 2 T2(x) + ..., with x going from -1\n");
+    printf("                                    at the start to 1 at the end of the segment\n");
+    printf("                                 x: With --doppler, the largest difference between\n");
+    printf("                                    the fit and the Doppler shift, in Hz\n");
+    printf("                                 The default is ndstel, followed by bf and the\n");
+    printf("                                 coefficients with --doppler\n");
+    printf("   --history                   : Treat all TLEs with the same catalog number as the\n");
+    printf("                                 history of one satellite, and use the TLE with the\n");
+    printf("                                 epoch closest to each point in time.\n");
+    printf("   --visible                   : Find only the passes, or the parts of passes, during\n");
+    printf("                                 which the satellite can be seen with the naked eye:\n");
+    printf("                                 the satellite is not in the shadow of the earth, and\n");
+    printf("                                 it is dark enough at the location.\n");
+    printf("   --sun-elevation=<ELEVATION> : With --visible, the highest elevation of the sun at\n");
+    printf("                                 which it is dark enough, in degrees. The default is\n");
+    printf("                                 -6, the end of civil twilight.\n");
+    printf("   --doppler=<FREQUENCY>       : Fit the Doppler shift of a signal from the\n");
+    printf("                                 satellite at <FREQUENCY> Hz over every pass, with\n");
+    printf("                                 a row for each segment of the pass. See the fields\n");
+    printf("                                 b, f, 0-9 and x.\n");
+    printf("   --doppler-degree=<DEGREE>   : The degree of the fit, at most 9. The default is 8.\n");
+    printf("   --doppler-tolerance=<HZ>    : Split a segment in two while the fit differs more\n");
+    printf("                                 than <HZ> Hz from the Doppler shift, down to\n");
+    printf("                                 segments of one second. The default is 1.\n");
     printf("-H,--headers                   : When the format is cols, first print a row with headers\n");
     printf("-g,--give-up-after=<HOURS>     : When no pass found after <HOURS> hours, give up with an\n");
     printf("                                 error. The default is 168 hours, or one week.\n");
@@ -75,14 +125,45 @@ static void usage_error(char *msg) {
 typedef struct {
     char *name;
     TLE *tle;
+    const tle_history *history; /* Only set with --history */
+    long valid_from, valid_until; /* The times for which tle is the nearest in history */
     int in_pass;
     time_t pass_start;
     time_t tca;
     double best_elevation;
     double best_azimuth;
     double start_azimuth;
+    double last_azimuth; /* The azimuth at the latest second of the pass */
 } scanner;
 
+/* A satellite that was dropped from the scan because SGP4 failed on it */
+typedef struct {
+    char *name;
+    int catalog_number;
+    time_t when;
+    int error;
+} dropped_satellite;
+
+static void report_dropped(const dropped_satellite *dropped, size_t nr_dropped) {
+    fprintf(stderr, "Warning: stopped searching for passes of %zu satellite%s for which SGP4 failed:\n",
+            nr_dropped, nr_dropped == 1 ? "" : "s");
+    for(size_t l=0; l<nr_dropped; l++) {
+        char when[32];
+        struct tm tm;
+        gmtime_r(&dropped[l].when, &tm);
+        strftime(when, sizeof when, "%Y-%m-%dT%H:%M:%SZ", &tm);
+        fprintf(stderr, "  %s (%d) at %s: %s\n", dropped[l].name ? dropped[l].name : "unknown",
+                dropped[l].catalog_number, when, getSGP4ErrorMessage(dropped[l].error));
+    }
+}
+
+#define OPT_HISTORY (256)
+#define OPT_VISIBLE (257)
+#define OPT_SUN_ELEVATION (258)
+#define OPT_DOPPLER (259)
+#define OPT_DOPPLER_DEGREE (260)
+#define OPT_DOPPLER_TOLERANCE (261)
+
 static field fields[] = {
     { "Pass start", "pass_start", 's', fld_type_time_string },
     { "Pass start", "pass_start", 'S', fld_type_time },
@@ -96,9 +177,131 @@ static field fields[] = {
     { "TCA azimuth", "tca_azimuth", 'z', fld_type_double },
     { "Start azimuth", "start_azimuth", 'Z', fld_type_double },
     { "End azimuth", "end_azimuth", 'Y', fld_type_double },
+    { "Doppler coefficient 0", "doppler_0", '0', fld_type_double },
+    { "Doppler coefficient 1", "doppler_1", '1', fld_type_double },
+    { "Doppler coefficient 2", "doppler_2", '2', fld_type_double },
+    { "Doppler coefficient 3", "doppler_3", '3', fld_type_double },
+    { "Doppler coefficient 4", "doppler_4", '4', fld_type_double },
+    { "Doppler coefficient 5", "doppler_5", '5', fld_type_double },
+    { "Doppler coefficient 6", "doppler_6", '6', fld_type_double },
+    { "Doppler coefficient 7", "doppler_7", '7', fld_type_double },
+    { "Doppler coefficient 8", "doppler_8", '8', fld_type_double },
+    { "Doppler coefficient 9", "doppler_9", '9', fld_type_double },
+    { "Doppler fit error", "doppler_fit_error", 'x', fld_type_double },
+    { "Segment start", "segment_start", 'b', fld_type_time_string },
+    { "Segment start", "segment_start", 'B', fld_type_time },
+    { "Segment end", "segment_end", 'f', fld_type_time_string },
+    { "Segment end", "segment_end", 'F', fld_type_time },
+    { "Start range rate", "start_range_rate", 'u', fld_type_double },
+    { "TCA range rate", "tca_range_rate", 'v', fld_type_double },
+    { "End range rate", "end_range_rate", 'w', fld_type_double },
+    { "Start Doppler rate", "start_doppler_rate", 'U', fld_type_double },
+    { "TCA Doppler rate", "tca_doppler_rate", 'V', fld_type_double },
+    { "End Doppler rate", "end_doppler_rate", 'W', fld_type_double },
     { NULL }
 };
 
+#define SPEED_OF_LIGHT (299792.458) /* In km/s */
+#define MAX_DOPPLER_DEGREE (9)
+
+/* The range rate in km/s of the satellite at the location, at the given time
+   in milliseconds since 1970. With a history, the TLE with the epoch closest
+   to that time is used */
+static double range_rate(const observer *obs, const tle_catalog *cat, const scanner *s, long when) {
+    TLE *tle = s->history ? &cat->tles[get_tle_nearest_epoch(cat, s->history, when, NULL, NULL)] : s->tle;
+    observer_frame frame;
+    observation o;
+    set_observer_frame(obs, &frame, when);
+    observe_in_frame(&frame, &o, tle);
+    return o.range_rate;
+}
+
+/*
+ * With --doppler, the Doppler shift over every pass is fit by a Chebyshev
+ * series in x, which goes from -1 at the start to 1 at the end of a segment
+ * of the pass. The series interpolates the Doppler shift at the Chebyshev
+ * nodes, which is nearly as close as the best fit and only takes degree + 1
+ * observations. A segment is split in two while the fit is not within the
+ * tolerance, so the segments are short where the shift changes quickly,
+ * around the closest approach.
+ */
+typedef struct {
+    const observer *obs;
+    const tle_catalog *cat;
+    double frequency;   /* In Hz */
+    int degree;
+    double tolerance;   /* In Hz */
+} doppler_fit;
+
+static double doppler_shift(const doppler_fit *d, const scanner *s, long when) {
+    return -d->frequency * range_rate(d->obs, d->cat, s, when) / SPEED_OF_LIGHT;
+}
+
+/* The rate of change of the Doppler shift in Hz/s, from the range rates half
+   a second before and after the given time in milliseconds since 1970 */
+static double doppler_rate(const doppler_fit *d, const scanner *s, long when) {
+    return doppler_shift(d, s, when + 500) - doppler_shift(d, s, when - 500);
+}
+
+/* Evaluates the Chebyshev series with Clenshaw's recurrence */
+static double chebyshev_series(const double *coefficients, int degree, double x) {
+    double b1 = 0, b2 = 0;
+    for(int j=degree; j>0; j--) {
+        double b0 = coefficients[j] + 2 * x * b1 - b2;
+        b2 = b1;
+        b1 = b0;
+    }
+    return coefficients[0] + x * b1 - b2;
+}
+
+/* Fits the Doppler shift over the segment from begin to end. Error is set to
+   the largest difference with the Doppler shift at points spread evenly over
+   the segment */
+static void fit_doppler(const doppler_fit *d, const scanner *s, time_t begin, time_t end,
+                        double coefficients[MAX_DOPPLER_DEGREE + 1], double *error) {
+    int n = d->degree + 1;
+    double mid = (begin + end) * 500.0, half = (end - begin) * 500.0;
+    double shifts[MAX_DOPPLER_DEGREE + 1];
+    for(int k=0; k<n; k++)
+        shifts[k] = doppler_shift(d, s, llround(mid + half * cos(M_PI * (k + 0.5) / n)));
+    for(int j=0; j<=MAX_DOPPLER_DEGREE; j++) {
+        coefficients[j] = 0;
+        if(j >= n) continue;
+        for(int k=0; k<n; k++) coefficients[j] += shifts[k] * cos(M_PI * j * (k + 0.5) / n);
+        coefficients[j] *= (j ? 2.0 : 1.0) / n;
+    }
+
+    *error = 0;
+    for(int k=0; k<=4*n; k++) {
+        double x = -1 + 2.0 * k / (4*n);
+        double difference = fabs(chebyshev_series(coefficients, d->degree, x) -
+                                 doppler_shift(d, s, llround(mid + half * x)));
+        if(difference > *error) *error = difference;
+    }
+}
+
+/* Renders a row for each segment of the pass from begin to end, with the
+   fields of the pass already in values */
+static void render_segments(const doppler_fit *d, const scanner *s, time_t begin, time_t end,
+                            output_plan *plan, field_value *values, int *rendered) {
+    double coefficients[MAX_DOPPLER_DEGREE + 1], error;
+    fit_doppler(d, s, begin, end, coefficients, &error);
+    if(error > d->tolerance && end - begin >= 2) {
+        time_t middle = begin + (end - begin) / 2;
+        render_segments(d, s, begin, middle, plan, values, rendered);
+        render_segments(d, s, middle, end, plan, values, rendered);
+        return;
+    }
+    for(int j=0; j<=MAX_DOPPLER_DEGREE; j++) values[12+j].value.double_value = coefficients[j];
+    values[22].value.double_value = error;
+    values[23].value.time_value = begin;
+    values[24].value.time_value = begin;
+    values[25].value.time_value = end;
+    values[26].value.time_value = end;
+    render(*rendered, plan, values);
+    (*rendered)++;
+}
+
 int main(int argc, char *argv[]) {
     executable = argv[0];
 
@@ -107,6 +310,7 @@ int main(int argc, char *argv[]) {
         { "version", no_argument, NULL, 'V' },
         { "location", required_argument, NULL, 'l' },
         { "satellite-name", required_argument, NULL, 'n' },
+        { "select", required_argument, NULL, 'S' },
         { "min-elevation", required_argument, NULL, 'e' },
         { "count", required_argument, NULL, 'c' },
         { "start", required_argument, NULL, 's' },
@@ -115,6 +319,12 @@ int main(int argc, char *argv[]) {
         { "fields", required_argument, NULL, 'F' },
         { "headers", no_argument, NULL, 'H' },
         { "give-up-after", required_argument, NULL, 'g' },
+        { "history", no_argument, NULL, OPT_HISTORY },
+        { "visible", no_argument, NULL, OPT_VISIBLE },
+        { "sun-elevation", required_argument, NULL, OPT_SUN_ELEVATION },
+        { "doppler", required_argument, NULL, OPT_DOPPLER },
+        { "doppler-degree", required_argument, NULL, OPT_DOPPLER_DEGREE },
+        { "doppler-tolerance", required_argument, NULL, OPT_DOPPLER_TOLERANCE },
         { NULL }
     };
 
@@ -133,18 +343,22 @@ int main(int argc, char *argv[]) {
     int count = 1;
     int has_count = 0;
     char *sat_name = NULL;
+    selection *sel = NULL;
     int min_elevation = 0;
     char *selector = NULL;
     int headers = 0;
     int give_up_after = 7 * 24;
+    int history = 0;
+    int visible = 0;
+    double sun_elevation = -6;
+    double doppler = 0;
+    int doppler_degree = 8;
+    double doppler_tolerance = 1;
 
-    enum {
-        fmt_auto,
-        fmt_cols,
-        fmt_rows
-    } fmt = fmt_auto;
+    output_format fmt;
+    int has_fmt = 0;
 
-    while((c = getopt_long(argc, argv, "hVl:n:e:c:s:E:f:F:Hg:", longopts, NULL)) != -1) {
+    while((c = getopt_long(argc, argv, "hVl:n:S:e:c:s:E:f:F:Hg:", longopts, NULL)) != -1) {
         switch(c) {
             case 'h':
                 usage();
@@ -160,6 +374,11 @@ int main(int argc, char *argv[]) {
                 free(sat_name);
                 sat_name = strdup(optarg);
                 break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
             case 'e':
                 if(optarg_as_int(&min_elevation, 0, 90))
                     usage_error("Invalid elevation");
@@ -179,9 +398,9 @@ int main(int argc, char *argv[]) {
                 has_end = 1;
                 break;
             case 'f':
-                if(string_starts_with("rows", optarg)) fmt = fmt_rows;
-                else if(string_starts_with("cols", optarg)) fmt = fmt_cols;
-                else usage_error("Invalid format");
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
+                has_fmt = 1;
                 break;
             case 'F':
                 if(check_selector(fields, optarg))
@@ -195,6 +414,28 @@ int main(int argc, char *argv[]) {
                 if(optarg_as_int(&give_up_after, 1, INT_MAX))
                     usage_error("Invalid give-up-after");
                 break;
+            case OPT_HISTORY:
+                history = 1;
+                break;
+            case OPT_VISIBLE:
+                visible = 1;
+                break;
+            case OPT_SUN_ELEVATION:
+                if(arg_as_double_incl_incl(optarg, &sun_elevation, -90, 90))
+                    usage_error("Invalid sun elevation");
+                break;
+            case OPT_DOPPLER:
+                if(arg_as_double_excl_excl(optarg, &doppler, 0, 1e15))
+                    usage_error("Invalid Doppler frequency");
+                break;
+            case OPT_DOPPLER_DEGREE:
+                if(optarg_as_int(&doppler_degree, 0, MAX_DOPPLER_DEGREE))
+                    usage_error("Invalid Doppler degree");
+                break;
+            case OPT_DOPPLER_TOLERANCE:
+                if(arg_as_double_excl_excl(optarg, &doppler_tolerance, 0, 1e15))
+                    usage_error("Invalid Doppler tolerance");
+                break;
             default:
                 usage_error("invalid option");
                 break;
@@ -206,59 +447,136 @@ int main(int argc, char *argv[]) {
     else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
     else usage_error("Supply a filename or set ORBIT_TOOLS_TLE");
 
-    loaded_tle *lt = load_tles_from_filename(file);
-    if(!lt) usage_error("Failed to read file");
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to read file");
+    if(!cat->count) usage_error("No satellites found");
+
+    if(history && index_tle_history(cat))
+        usage_error("Failed to index TLE history");
 
-    int nr_sats;
+    size_t nr_sats;
     scanner *scanners;
 
     if(sat_name) {
         nr_sats=1;
-        loaded_tle *target = get_tle_by_name(lt, sat_name);
-        if(!target) {
-            unload_tles(lt);
+        size_t target = get_tle_by_name(cat, sat_name);
+        if(target == TLE_NOT_FOUND) {
+            unload_tles(cat);
             usage_error("Satellite not found");
         }
         scanners = malloc(sizeof(scanner));
         scanners->name=sat_name;
-        scanners->tle=&target->tle;
+        scanners->tle=&cat->tles[target];
+        scanners->history = history ? get_tle_history(cat, target) : NULL;
+    } else if(history) {
+        /* One scanner per satellite, named after the first TLE with a name */
+        nr_sats = cat->nr_histories;
+        scanners = malloc(sizeof(scanner) * nr_sats);
+        for(size_t l=0; l<nr_sats; l++) {
+            const tle_history *h = &cat->histories[l];
+            scanners[l].name = NULL;
+            for(size_t e=0; e<h->count && !scanners[l].name; e++)
+                scanners[l].name = cat->names[h->entries[e]];
+            scanners[l].tle = &cat->tles[h->entries[0]];
+            scanners[l].history = h;
+        }
     } else {
-        nr_sats = count_tles(lt);
+        nr_sats = count_tles(cat);
         scanners = malloc(sizeof(scanner) * nr_sats);
         for(size_t l=0; l<nr_sats; l++) {
-            loaded_tle *p = get_tle_by_index(lt, l);
-            scanners[l].name = p->name;
-            scanners[l].tle = &p->tle;
+            scanners[l].name = cat->names[l];
+            scanners[l].tle = &cat->tles[l];
+            scanners[l].history = NULL;
         }
     }
     for(size_t l=0; l<nr_sats; l++) {
         scanners[l].in_pass = 0;
+        /* Force a lookup in the history on the first step */
+        scanners[l].valid_from = 1;
+        scanners[l].valid_until = 0;
     }
 
-    if(fmt == fmt_auto) fmt = has_count | has_end ? fmt_cols : fmt_rows;
+    if(!has_fmt) fmt = has_count | has_end ? output_cols : output_rows;
 
-    if(!selector) selector = "ndstel";
+    char default_selector[32] = "ndstel";
+    if(doppler) {
+        strcat(default_selector, "bf");
+        for(int l=0; l<=doppler_degree; l++) default_selector[8+l] = '0' + l;
+    }
+    if(!selector) selector = default_selector;
+    else if(!doppler && strpbrk(selector, "0123456789xbBfFUVW"))
+        usage_error("The Doppler fields need --doppler");
+    output_plan *plan = plan_output(fields, selector, fmt);
+    /* With --doppler, the number of segments is not known in advance */
+    if(!has_end && !doppler) plan->expected_rows = count;
 
     field_value values[sizeof fields/sizeof fields[0] - 1 ];
+    doppler_fit fit = { &obs, cat, doppler, doppler_degree, doppler_tolerance };
+    int rendered = 0;
+
+    dropped_satellite *dropped = malloc(sizeof(dropped_satellite) * nr_sats);
+    size_t nr_dropped = 0;
 
-    if(fmt == fmt_cols && headers) render_headers(fields, selector);
+    if(fmt == output_cols && headers) render_headers(plan);
 
     size_t pass_count = 0;
     long long int keep_going = give_up_after * 60 * 60;
     while((pass_count < count || (has_end && !has_count)) && 
           (!has_end || start.tv_sec < end.tv_sec) &&
-           keep_going) {
+           keep_going && nr_sats) {
         observation result;
+        observer_frame frame;
+        set_observer_frame(&obs, &frame, start.tv_sec * 1000L);
+        /* With --visible, the sun is only needed once for all satellites, and
+           while it is too light no pass can start */
+        double sun[3];
+        int dark = 1;
+        if(visible) {
+            sun_position(start.tv_sec * 1000L, sun);
+            dark = elevation_in_frame(&frame, sun) <= sun_elevation;
+        }
+        /* Satellites for which SGP4 fails are dropped from the scan; the others are
+           moved up, so their order does not change */
+        size_t kept = 0;
         for(size_t l=0; l<nr_sats; l++) {
-            observe(&obs, &result, scanners[l].tle, start.tv_sec);
-            if(result.elevation >= min_elevation && !scanners[l].in_pass) {
+            if(!dark && !scanners[l].in_pass) {
+                if(kept != l) scanners[kept] = scanners[l];
+                kept++;
+                continue;
+            }
+            if(scanners[l].history) {
+                long when = start.tv_sec * 1000L;
+                if(when < scanners[l].valid_from || when > scanners[l].valid_until)
+                    scanners[l].tle = &cat->tles[get_tle_nearest_epoch(cat, scanners[l].history, when,
+                                                                       &scanners[l].valid_from,
+                                                                       &scanners[l].valid_until)];
+            }
+            observe_in_frame(&frame, &result, scanners[l].tle);
+            /* With a history, a later TLE may still be usable */
+            int drop = scanners[l].tle->sgp4Error &&
+                       (!scanners[l].history || scanners[l].valid_until == LONG_MAX);
+            if(drop) {
+                dropped[nr_dropped].name = scanners[l].name;
+                dropped[nr_dropped].catalog_number = cat->catalog_numbers[scanners[l].tle - cat->tles];
+                dropped[nr_dropped].when = start.tv_sec;
+                dropped[nr_dropped].error = scanners[l].tle->sgp4Error;
+                nr_dropped++;
+            }
+            /* A pass in progress when SGP4 fails ends at the last second it worked,
+               also when the satellite is dropped. A TLE in the history that fails is
+               skipped until the next one takes over. Whether the satellite is sunlit
+               only matters when it is up */
+            int failed = scanners[l].tle->sgp4Error != 0;
+            int up = !failed && result.elevation >= min_elevation;
+            if(up && visible) up = dark && get_shadow(result.sat_eci, sun) != shadow_umbra;
+            if(up && !scanners[l].in_pass) {
                 scanners[l].pass_start = start.tv_sec;
                 scanners[l].in_pass = 1;
                 scanners[l].best_elevation = result.elevation;
                 scanners[l].best_azimuth = result.azimuth;
                 scanners[l].tca = start.tv_sec;
                 scanners[l].start_azimuth = result.azimuth;
-            } else if(result.elevation < min_elevation && scanners[l].in_pass) {
+            } else if(!up && scanners[l].in_pass) {
                 scanners[l].in_pass = 0;
                 time_t begin = scanners[l].pass_start, end = start.tv_sec-1;
                 values[0].value.time_value = begin;
@@ -272,8 +590,19 @@ int main(int argc, char *argv[]) {
                 values[8].value.string_value = scanners[l].name ? scanners[l].name : "unknown";
                 values[9].value.double_value = scanners[l].best_azimuth;
                 values[10].value.double_value = scanners[l].start_azimuth;
-                values[11].value.double_value = result.azimuth;
-                render(pass_count, fields, values, selector, fmt == fmt_rows);
+                values[11].value.double_value = failed ? scanners[l].last_azimuth : result.azimuth;
+                values[27].value.double_value = range_rate(&obs, cat, &scanners[l], begin * 1000L);
+                values[28].value.double_value = range_rate(&obs, cat, &scanners[l], scanners[l].tca * 1000L);
+                values[29].value.double_value = range_rate(&obs, cat, &scanners[l], end * 1000L);
+                if(doppler) {
+                    values[30].value.double_value = doppler_rate(&fit, &scanners[l], begin * 1000L);
+                    values[31].value.double_value = doppler_rate(&fit, &scanners[l], scanners[l].tca * 1000L);
+                    values[32].value.double_value = doppler_rate(&fit, &scanners[l], end * 1000L);
+                    render_segments(&fit, &scanners[l], begin, end, plan, values, &rendered);
+                } else {
+                    render(rendered, plan, values);
+                    rendered++;
+                }
                 pass_count++;
                 keep_going = give_up_after * 60 * 60;
             } else if(scanners[l].in_pass && result.elevation > scanners[l].best_elevation) {
@@ -281,14 +610,33 @@ int main(int argc, char *argv[]) {
                 scanners[l].best_azimuth = result.azimuth;
                 scanners[l].tca = start.tv_sec;
             }
+            if(scanners[l].in_pass) scanners[l].last_azimuth = result.azimuth;
+            if(drop) continue;
+            if(kept != l) scanners[kept] = scanners[l];
+            kept++;
         }
+        nr_sats = kept;
         start.tv_sec++;
         keep_going--;
     }
 
-    if(!keep_going) {
+    if(nr_dropped) report_dropped(dropped, nr_dropped);
+
+    int result = 0;
+    if(!nr_sats) {
+        fprintf(stderr, "No satellites left to find passes for\n");
+        result = EX_UNAVAILABLE;
+    } else if(!keep_going) {
         fprintf(stderr, "No more passes found within %d hours. Consider increasing --give-up-after\n",
                         give_up_after);
-        exit(EX_UNAVAILABLE);
+        result = EX_UNAVAILABLE;
     }
+
+    close_output(plan);
+    free(dropped);
+    free(scanners);
+    unload_tles(cat);
+    free_selection(sel);
+    free(sat_name);
+    return result;
 }
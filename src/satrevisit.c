@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <math.h>
+#include <sysexits.h>
+#include <getopt.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "opt_util.h"
+#include "tle_loader.h"
+#include "selection.h"
+#include "TLE.h"
+#include "observer.h"
+#include "locations.h"
+#include "util.h"
+#include "output.h"
+#include "version.h"
+#include "debug.h"
+#include "workers.h"
+
+static char *executable;
+
+static void usage(void) {
+    printf("Usage: %s [OPTION...] [<TLE-FILE>]\n", executable);
+    printf("\n");
+    printf("Calculates, for one or more locations on the ground, statistics of the gaps\n");
+    printf("between the passes of the satellites in <TLE-FILE>: the periods during which\n");
+    printf("none of the satellites is visible with at least the minimum elevation.\n");
+    printf("\n");
+    printf("<TLE-FILE> is a file containing one or more TLEs. Use\n");
+    printf("- to read the TLEs from stdin. If <TLE-FILE> is not supplied\n");
+    printf("then $ORBIT_TOOLS_TLE must be set to the filename to be used\n");
+    printf("\n");
+    printf("Options are:\n");
+    printf("-h,--help                      : Print this help and exit\n");
+    printf("-V,--version                   : Print version and exit\n");
+    printf("-v,--verbose                   : Print debug logging\n");
+    printf("-l,--location=<LAT,LON>        : Add a location on the ground, in degrees. Can be\n");
+    printf("                                 given more than once. The default is 0,0 when no\n");
+    printf("                                 locations are given.\n");
+    printf("-L,--locations=<FILE>          : Add the locations in <FILE>, which has a location\n");
+    printf("                                 formatted as LAT,LON on every line, optionally\n");
+    printf("                                 followed by a space and a name. Empty lines and\n");
+    printf("                                 lines starting with # are skipped.\n");
+    printf("-S,--select=<SELECTION>        : Only use the selected satellites from the TLE\n");
+    printf("                                 file. <SELECTION> is a comma-separated list of\n");
+    printf("                                 names, patterns like FLOCK*, catalog numbers and\n");
+    printf("                                 ranges of catalog numbers like 40000-40100.\n");
+    printf("-e,--min-elevation=<ELEVATION> : A satellite is visible when its elevation is at\n");
+    printf("                                 least <ELEVATION> degrees. The default is 0.\n");
+    printf("-s,--start=<START>             : The start of the period, specified as\n");
+    printf("                                 yyyy-mm-ddThh:mm:ssZ or yyyy-mm-dd. The default is\n");
+    printf("                                 the current date and time.\n");
+    printf("-E,--end=<END>                 : The end of the period, specified like the start.\n");
+    printf("                                 The default is one day after the start.\n");
+    printf("-i,--interval=<INTERVAL>       : The time between the moments at which visibility\n");
+    printf("                                 is determined, in seconds. The default is 10. With\n");
+    printf("                                 1, passes are the same as those found by satpass.\n");
+    printf("   --bin-width=<SECONDS>       : The width of the bins of the histogram of gap\n");
+    printf("                                 lengths. The default is 60.\n");
+    printf("   --bins=<BINS>               : The number of bins of the histogram. The last bin\n");
+    printf("                                 also counts all longer gaps. The default is 240.\n");
+    printf("   --histogram                 : Print the histogram of gap lengths of every\n");
+    printf("                                 location, instead of the statistics.\n");
+    printf("   --threads=<THREADS>         : The number of threads. The default is the number\n");
+    printf("                                 of CPUs.\n");
+    printf("-f,--format=rows|cols|csv|ndjson|binary|npy\n");
+    printf("                               : Sets the output format. The default is cols.\n");
+    printf("-H,--headers                   : When the format is cols, first print a row with headers\n");
+    printf("-F,--fields=<FIELDS>           : Specifies the fields to include in the output.\n");
+    printf("                                 <FIELDS> is a string consisting of:\n");
+    printf("                                 n: The name of the location\n");
+    printf("                                 a: The latitude of the location\n");
+    printf("                                 o: The longitude of the location\n");
+    printf("                                 c: The fraction of time a satellite is visible\n");
+    printf("                                 g: The number of gaps\n");
+    printf("                                 m: The mean gap length, in seconds\n");
+    printf("                                 x: The longest gap, in seconds\n");
+    printf("                                 d: The median gap length, in seconds\n");
+    printf("                                 q: The 90th percentile of gap lengths, in seconds\n");
+    printf("                                 Q: The 99th percentile of gap lengths, in seconds\n");
+    printf("                                 The default is ncgmxdq\n");
+    printf("                                 With --histogram, <FIELDS> consists of:\n");
+    printf("                                 n: The name of the location\n");
+    printf("                                 a: The latitude of the location\n");
+    printf("                                 o: The longitude of the location\n");
+    printf("                                 b: The shortest gap length in the bin, in seconds\n");
+    printf("                                 k: The number of gaps in the bin\n");
+    printf("                                 The default is nbk\n");
+    printf("\n");
+    printf("Only gaps that start and end within the period are counted. The percentiles\n");
+    printf("are interpolated within the bins of the histogram.\n");
+}
+
+static void usage_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n\n%s --help for help\n", msg, executable);
+    exit(EX_USAGE);
+}
+
+#define OPT_BIN_WIDTH (256)
+#define OPT_BINS (257)
+#define OPT_HISTOGRAM (258)
+#define OPT_THREADS (259)
+
+static field fields[] = {
+    { "Location", "location", 'n', fld_type_string },
+    { "Latitude", "latitude", 'a', fld_type_double },
+    { "Longitude", "longitude", 'o', fld_type_double },
+    { "Coverage", "coverage", 'c', fld_type_double },
+    { "Gaps", "gaps", 'g', fld_type_int },
+    { "Mean gap", "mean_gap", 'm', fld_type_double },
+    { "Longest gap", "longest_gap", 'x', fld_type_time },
+    { "Median gap", "median_gap", 'd', fld_type_double },
+    { "90th percentile gap", "p90_gap", 'q', fld_type_double },
+    { "99th percentile gap", "p99_gap", 'Q', fld_type_double },
+    { NULL }
+};
+
+static field histogram_fields[] = {
+    { "Location", "location", 'n', fld_type_string },
+    { "Latitude", "latitude", 'a', fld_type_double },
+    { "Longitude", "longitude", 'o', fld_type_double },
+    { "Gap length", "gap_length", 'b', fld_type_time },
+    { "Gaps", "gaps", 'k', fld_type_int },
+    { NULL }
+};
+
+/*
+ * A location on the ground, and what is known about its gaps so far. Apart
+ * from the histogram, whose size is fixed by --bins, the memory needed for a
+ * location does not depend on the length of the period.
+ */
+typedef struct {
+    const location *where;
+    double ecef[3], up[3];
+    int visible;            /* Whether a satellite was visible at the previous moment */
+    int seen;               /* Whether a satellite has been visible at all */
+    size_t last_visible;    /* The satellite last seen, which is tried first */
+    long gap_start;         /* The first moment of the current gap */
+    long visible_moments;
+    int nr_gaps;
+    double total_gap;
+    long shortest_gap, longest_gap;
+    int *histogram;
+} site;
+
+/*
+ * The period is handled in batches of moments. For every batch, the positions
+ * of the satellites at all its moments are calculated first. Then the
+ * locations are divided over the threads, which each go through the moments
+ * of the batch for their locations.
+ */
+
+/* A batch contains at most this many positions */
+#define BATCH_POSITIONS (65536)
+
+typedef struct {
+    propagation p;              /* In ECEF */
+    site *sites;
+    double sin_sq_min_elevation;
+    int bin_width, nr_bins;
+    long first;                 /* The first moment of the batch, in seconds since 1970 */
+    size_t nr_moments;
+    int interval;
+} batch;
+
+typedef struct {
+    batch *b;
+    size_t first_tle, last_tle;
+    size_t first_site, last_site;
+} worker;
+
+static void *propagate(void *arg) {
+    worker *w = arg;
+    propagate_tles(&w->b->p, w->first_tle, w->last_tle, 0, w->b->nr_moments);
+    return NULL;
+}
+
+/* The elevation is the angle between the direction of the satellite and the
+   plane perpendicular to the location's position vector, as in observe().
+   A satellite at NAN is never visible */
+static int is_visible(const site *s, const double sat_ecef[3], double sin_sq_min_elevation) {
+    double dir[3] = { sat_ecef[0] - s->ecef[0], sat_ecef[1] - s->ecef[1], sat_ecef[2] - s->ecef[2] };
+    double up = dot_product(dir, s->up);
+    if(!(up >= 0)) return 0;
+    return up * up >= sin_sq_min_elevation * dot_product(dir, dir);
+}
+
+static void add_gap(site *s, const batch *b, long gap) {
+    if(!s->nr_gaps || gap < s->shortest_gap) s->shortest_gap = gap;
+    if(!s->nr_gaps || gap > s->longest_gap) s->longest_gap = gap;
+    s->nr_gaps++;
+    s->total_gap += gap;
+    long bin = gap / b->bin_width;
+    s->histogram[bin < b->nr_bins ? bin : b->nr_bins - 1]++;
+}
+
+static void *revisit(void *arg) {
+    worker *w = arg;
+    batch *b = w->b;
+    for(size_t l=w->first_site; l<w->last_site; l++) {
+        site *s = &b->sites[l];
+        for(size_t m=0; m<b->nr_moments; m++) {
+            const double *positions = &b->p.states[m * b->p.nr_tles * 3];
+            int visible = is_visible(s, &positions[s->last_visible * 3], b->sin_sq_min_elevation);
+            for(size_t t=0; t<b->p.nr_tles && !visible; t++) {
+                if(is_visible(s, &positions[t * 3], b->sin_sq_min_elevation)) {
+                    s->last_visible = t;
+                    visible = 1;
+                }
+            }
+            long when = b->first + (long)m * b->interval;
+            if(visible) {
+                s->visible_moments++;
+                if(!s->visible && s->seen) add_gap(s, b, when - s->gap_start);
+                s->seen = 1;
+            } else if(s->visible) {
+                s->gap_start = when;
+            }
+            s->visible = visible;
+        }
+    }
+    return NULL;
+}
+
+/* Returns the gap length below which the given percentage of the gaps falls,
+   interpolated linearly within the bin of the histogram in which it falls */
+static double gap_percentile(const site *s, int bin_width, int nr_bins, double percentage) {
+    if(!s->nr_gaps) return NAN;
+    double rank = percentage / 100.0 * s->nr_gaps;
+    long below = 0;
+    for(int bin=0; bin<nr_bins; bin++) {
+        if(s->histogram[bin] && below + s->histogram[bin] >= rank) {
+            double lower = (double)bin * bin_width, upper = (double)(bin + 1) * bin_width;
+            if(lower < s->shortest_gap) lower = s->shortest_gap;
+            if(bin == nr_bins - 1 || upper > s->longest_gap) upper = s->longest_gap;
+            return lower + (upper - lower) * (rank - below) / s->histogram[bin];
+        }
+        below += s->histogram[bin];
+    }
+    return s->longest_gap;
+}
+
+int main(int argc, char *argv[]) {
+    executable = argv[0];
+    struct option longopts[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'V' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "location", required_argument, NULL, 'l' },
+        { "locations", required_argument, NULL, 'L' },
+        { "select", required_argument, NULL, 'S' },
+        { "min-elevation", required_argument, NULL, 'e' },
+        { "start", required_argument, NULL, 's' },
+        { "end", required_argument, NULL, 'E' },
+        { "interval", required_argument, NULL, 'i' },
+        { "bin-width", required_argument, NULL, OPT_BIN_WIDTH },
+        { "bins", required_argument, NULL, OPT_BINS },
+        { "histogram", no_argument, NULL, OPT_HISTOGRAM },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "format", required_argument, NULL, 'f' },
+        { "fields", required_argument, NULL, 'F' },
+        { "headers", no_argument, NULL, 'H' },
+        { NULL }
+    };
+
+    opterr = 0;
+    int c;
+    struct timeval now;
+    gettimeofday(&now, 0);
+    time_t start = now.tv_sec, end = 0;
+    int has_end = 0;
+    int interval = 10;
+    int bin_width = 60, nr_bins = 240;
+    int histogram = 0;
+    location_list locations = { NULL, 0, 0 };
+    selection *sel = NULL;
+    int min_elevation = 0;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nr_threads = nr_cpus > 1 ? (int)nr_cpus : 1;
+    char *selector = NULL;
+    int headers = 0;
+    output_format fmt = output_cols;
+
+    while((c = getopt_long(argc, argv, "hVvl:L:S:e:s:E:i:f:F:H", longopts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                exit(0);
+            case 'V':
+                printf("%s\n", VERSION);
+                exit(0);
+            case 'v':
+                debug_enable(1);
+                break;
+            case 'l': {
+                double lat, lon;
+                if(optarg_as_lon_lat(&lon, &lat))
+                    usage_error("Invalid location");
+                if(add_location(&locations, optarg, lat, lon))
+                    usage_error("Out of memory");
+                break;
+            }
+            case 'L':
+                if(read_locations(&locations, optarg))
+                    usage_error("Failed to read locations");
+                break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
+            case 'e':
+                if(optarg_as_int(&min_elevation, 0, 90))
+                    usage_error("Invalid elevation");
+                break;
+            case 's':
+                if(optarg_as_datetime_extended(&start))
+                    usage_error("Invalid start");
+                break;
+            case 'E':
+                if(optarg_as_datetime_extended(&end))
+                    usage_error("Invalid end");
+                has_end = 1;
+                break;
+            case 'i':
+                if(optarg_as_int(&interval, 1, INT_MAX))
+                    usage_error("Invalid interval");
+                break;
+            case OPT_BIN_WIDTH:
+                if(optarg_as_int(&bin_width, 1, INT_MAX))
+                    usage_error("Invalid bin width");
+                break;
+            case OPT_BINS:
+                if(optarg_as_int(&nr_bins, 1, 1000000))
+                    usage_error("Invalid number of bins");
+                break;
+            case OPT_HISTOGRAM:
+                histogram = 1;
+                break;
+            case OPT_THREADS:
+                if(optarg_as_int(&nr_threads, 1, 1024))
+                    usage_error("Invalid number of threads");
+                break;
+            case 'f':
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
+                break;
+            case 'F':
+                free(selector);
+                selector = strdup(optarg);
+                break;
+            case 'H':
+                headers = 1;
+                break;
+            default:
+                usage_error("Invalid option");
+                break;
+        }
+    }
+
+    /* The fields depend on --histogram, which may come after --fields */
+    field *output_fields = histogram ? histogram_fields : fields;
+    if(selector && check_selector(output_fields, selector))
+        usage_error("Invalid fields-string");
+
+    char *file = NULL;
+    if(optind == argc-1) file = argv[argc-1];
+    else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
+    else usage_error("Supply a filename or set ORBIT_TOOLS_TLE");
+
+    if(!has_end) end = start + 24 * 3600;
+    if(end <= start) usage_error("The end must be after the start");
+    if(!locations.count && add_location(&locations, "0,0", 0, 0))
+        usage_error("Out of memory");
+
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to read file");
+    if(!cat->count) usage_error("No satellites found");
+
+    size_t nr_sites = locations.count;
+    site *sites = calloc(nr_sites, sizeof(site));
+    int *histograms = calloc(nr_sites * nr_bins, sizeof(int));
+    if(!sites || !histograms) usage_error("Out of memory");
+    for(size_t l=0; l<nr_sites; l++) {
+        site *s = &sites[l];
+        s->where = &locations.locations[l];
+        observer obs = { s->where->lon, s->where->lat, 0 };
+        observer_frame frame;
+        set_observer_frame(&obs, &frame, 0);
+        vec3_copy(s->ecef, frame.obs_ecef);
+        vec3_norm(s->ecef, s->up);
+        s->histogram = &histograms[l * nr_bins];
+    }
+
+    /* The moments are start, start + interval, ... up to but not including end */
+    long nr_moments = ((long)(end - start) + interval - 1) / interval;
+    size_t per_batch = BATCH_POSITIONS / cat->count;
+    if(per_batch < 1) per_batch = 1;
+    if(per_batch > nr_moments) per_batch = nr_moments;
+
+    double sin_min_elevation = sin(deg_to_rad(min_elevation));
+    long *times = malloc(per_batch * sizeof(long));
+    double *rotations = malloc(per_batch * 2 * sizeof(double));
+    batch b = { { cat->tles, cat->count, calloc(cat->count, 1), times, rotations, 0,
+                  malloc(per_batch * cat->count * 3 * sizeof(double)) },
+                sites, sin_min_elevation * sin_min_elevation, bin_width, nr_bins,
+                start, 0, interval };
+    worker *workers = malloc(nr_threads * sizeof(worker));
+    if(!times || !rotations || !b.p.failed || !b.p.states || !workers) usage_error("Out of memory");
+    for(int l=0; l<nr_threads; l++) {
+        workers[l].b = &b;
+        workers[l].first_tle = cat->count * l / nr_threads;
+        workers[l].last_tle = cat->count * (l+1) / nr_threads;
+        workers[l].first_site = nr_sites * l / nr_threads;
+        workers[l].last_site = nr_sites * (l+1) / nr_threads;
+    }
+    DEBUG("%zu satellites, %zu locations, %ld moments, %zu moments per batch, %d threads",
+          cat->count, nr_sites, nr_moments, per_batch, nr_threads);
+
+    for(long done=0; done<nr_moments; done+=b.nr_moments) {
+        b.first = start + done * interval;
+        b.nr_moments = nr_moments - done < per_batch ? nr_moments - done : per_batch;
+        for(size_t m=0; m<b.nr_moments; m++) {
+            times[m] = (b.first + (long)m * interval) * 1000L;
+            earth_rotation(b.first + (long)m * interval, &rotations[2*m], &rotations[2*m+1]);
+        }
+        run_workers(workers, sizeof(worker), nr_threads, propagate);
+        run_workers(workers, sizeof(worker), nr_threads, revisit);
+    }
+
+    report_sgp4_failures(b.p.failed, cat->count, "whose passes are left out while it fails");
+
+    output_plan *plan = plan_output(output_fields, selector ? selector : histogram ? "nbk" : "ncgmxdq", fmt);
+    plan->expected_rows = histogram ? nr_sites * nr_bins : nr_sites;
+    if(fmt == output_cols && headers) render_headers(plan);
+    field_value values[sizeof fields / sizeof fields[0] - 1];
+    int rendered = 0;
+    for(size_t l=0; l<nr_sites; l++) {
+        site *s = &sites[l];
+        values[0].value.string_value = s->where->name;
+        values[1].value.double_value = s->where->lat;
+        values[2].value.double_value = s->where->lon;
+        if(histogram) {
+            for(int bin=0; bin<nr_bins; bin++) {
+                values[3].value.time_value = (time_t)bin * bin_width;
+                values[4].value.int_value = s->histogram[bin];
+                render(rendered++, plan, values);
+            }
+            continue;
+        }
+        values[3].value.double_value = (double)s->visible_moments / nr_moments;
+        values[4].value.int_value = s->nr_gaps;
+        values[5].value.double_value = s->nr_gaps ? s->total_gap / s->nr_gaps : NAN;
+        values[6].value.time_value = s->longest_gap;
+        values[7].value.double_value = gap_percentile(s, bin_width, nr_bins, 50);
+        values[8].value.double_value = gap_percentile(s, bin_width, nr_bins, 90);
+        values[9].value.double_value = gap_percentile(s, bin_width, nr_bins, 99);
+        render(rendered++, plan, values);
+    }
+
+    close_output(plan);
+    free(sites);
+    free(histograms);
+    free_locations(&locations);
+    free(workers);
+    free(b.p.failed);
+    free(b.p.states);
+    free(times);
+    free(rotations);
+    unload_tles(cat);
+    free_selection(sel);
+    free(selector);
+    return 0;
+}
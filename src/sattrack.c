@@ -6,14 +6,22 @@
 #include <sysexits.h>
 #include <limits.h>
 #include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "TLE.h"
 #include "opt_util.h"
 #include "tle_loader.h"
+#include "selection.h"
 #include "observer.h"
+#include "locations.h"
+#include "ssp_index.h"
 #include "util.h"
 #include "output.h"
 #include "version.h"
 #include "debug.h"
+#include "workers.h"
 
 static char *executable;
 
@@ -25,20 +33,65 @@ static void usage(void) {
     printf("-V,--version               : print version and exit.\n");
     printf("-v,--verbose               : print debug logging.\n");
     printf("-l,--location=<LAT,LON>    : specify the location on the ground, in degrees.\n");
-    printf("                             The default is 0,0.\n");
-    printf("-s,--start=<TIMESTAMP>     : specify the date and time at which to start the,\n");
-    printf("                             calculation, formatted as yyyy-mm-ddThh-mm-ssZ.\n");
+    printf("                             The default is 0,0. With --overhead, every -l adds\n");
+    printf("                             a location.\n");
+    printf("-L,--locations=<FILE>      : with --overhead, add the locations in <FILE>, which\n");
+    printf("                             has a location formatted as LAT,LON on every line,\n");
+    printf("                             optionally followed by a name.\n");
+    printf("-e,--min-elevation=<ELEVATION>\n");
+    printf("                           : with --overhead, the minimum elevation in degrees at\n");
+    printf("                             which a satellite is shown. The default is 0.\n");
+    printf("-s,--start=<TIMESTAMP>     : specify the date and time at which to start the\n");
+    printf("                             calculation, formatted as yyyy-mm-ddThh:mm:ssZ or,\n");
+    printf("                             with milliseconds, yyyy-mm-ddThh:mm:ss.sssZ.\n");
     printf("                             The default is the current date and time.\n");
     printf("-c,--count=<COUNT>         : specify the number of calculations to perform.\n");
     printf("                             The default is 1.\n");
     printf("-i,--interval=<INTERVAL>   : specify the interval between consecutive\n");
-    printf("                             calculations in seconds. The default is 1.\n");
+    printf("                             calculations in seconds, with up to 3 decimals.\n");
+    printf("                             The default is 1. When the start or interval is\n");
+    printf("                             not a whole number of seconds, times are shown\n");
+    printf("                             with milliseconds.\n");
     printf("-n,--satellite-name=<NAME> : in case the TLE file contains data of multiple\n");
     printf("                             satellites, specify the name of the satellite to\n");
     printf("                             be used. The default is to use the first satellite\n");
     printf("                             from the file.\n");
-    printf("-f,--format=rows|cols      : sets the output format. When not specified, rows is\n");
-    printf("                             used when count is 1, otherwise cols\n");
+    printf("-S,--select=<SELECTION>    : only load the selected satellites from the TLE file.\n");
+    printf("                             <SELECTION> is a comma-separated list of names,\n");
+    printf("                             patterns like FLOCK*, catalog numbers and ranges of\n");
+    printf("                             catalog numbers like 40000-40100. The first selected\n");
+    printf("                             satellite is used.\n");
+    printf("   --stream                : track every (selected) satellite in the TLE file, as\n");
+    printf("                             soon as its TLE has been read, instead of loading the\n");
+    printf("                             whole file first. Memory use does not depend on the size\n");
+    printf("                             of the file. Together with --satellite-name, only the first\n");
+    printf("                             satellite with that name is tracked.\n");
+    printf("   --history               : treat all TLEs with the same catalog number as the\n");
+    printf("                             history of the satellite, and use the TLE with the\n");
+    printf("                             epoch closest to each point in time. Can not be\n");
+    printf("                             combined with --stream.\n");
+    printf("   --all                   : track all (selected) satellites in the TLE file at the\n");
+    printf("                             same time, with a row per satellite per point in time.\n");
+    printf("                             The satellite name is included in the default fields.\n");
+    printf("                             Can not be combined with --satellite-name or --stream.\n");
+    printf("   --overhead              : show the (selected) satellites that are visible from\n");
+    printf("                             each location, with a row per location and satellite\n");
+    printf("                             per point in time. Every satellite is propagated once\n");
+    printf("                             per point in time, and only observed from the\n");
+    printf("                             locations its footprint may reach. Can not be combined\n");
+    printf("                             with --satellite-name, --all or --stream.\n");
+    printf("   --threads=<THREADS>     : the number of threads used to calculate the positions\n");
+    printf("                             with --all. The default is the number of CPUs.\n");
+    printf("   --follow[=<INTERVAL>]   : keep running, and show the location every INTERVAL\n");
+    printf("                             seconds (by default the value of --interval), at\n");
+    printf("                             wall-clock times that are a multiple of INTERVAL. The\n");
+    printf("                             TLE file is read again when it changes. Can not be\n");
+    printf("                             combined with --start, --count or --stream.\n");
+    printf("-f,--format=rows|cols|csv|ndjson|binary|npy\n");
+    printf("                           : sets the output format. When not specified, rows is\n");
+    printf("                             used when count is 1 and --all is not used, otherwise\n");
+    printf("                             cols. binary and npy write fixed-size records, see\n");
+    printf("                             README.md\n");
     printf("-H,--headers               : when output format is cols, print a row with headers\n");
     printf("                             as first row\n");
     printf("-F,--fields=<FIELDS>       : specifies the fields to print. <FIELDS> consists of the\n");
@@ -65,19 +118,31 @@ static void usage(void) {
     printf("                                projected onto the plane tangential to the earth surface at the\n");
     printf("                                SSP in km/s\n");
     printf("                             G: The satellite's ground-track direction in degrees\n");
+    printf("                             n: The name of the satellite\n");
+    printf("                             L: The name of the location\n");
+    printf("                             R: The range rate, in km/s, positive when the satellite\n");
+    printf("                                moves away from the location\n");
     printf("                             The default is trezoaA when a location is specified,\n");
-    printf("                             toaA when no location is specified.\n");
+    printf("                             toaA when no location is specified, and tLnrlz with\n");
+    printf("                             --overhead.\n");
     printf("\n");
     printf("<TLE-FILE> is the path to the TLE file. Use - to read from stdin. When\n");
     printf("<TLE-FILE> is not supplied, environment variable $ORBIT_TOOLS_TLE is consulted\n");
     printf("for the file to be used.\n");
 }
 
-static void usage_error(char *msg) {
+static void usage_error(const char *msg) {
     fprintf(stderr, "Error: %s\n\n%s --help for help\n", msg, executable);
     exit(EX_USAGE);
 }
 
+#define OPT_STREAM (256)
+#define OPT_HISTORY (257)
+#define OPT_ALL (258)
+#define OPT_THREADS (259)
+#define OPT_FOLLOW (260)
+#define OPT_OVERHEAD (261)
+
 static field fields[] = {
     { "Time", "time", 't', fld_type_time_string },
     { "Time", "time", 'T', fld_type_time },
@@ -96,9 +161,408 @@ static field fields[] = {
     { "Velocity ECI Z", "velocity_eci_z", '3', fld_type_double },
     { "Ground-track velocity", "groundtrack_velocity", 'g', fld_type_double },
     { "Ground-track direction", "groundtrack_direction", 'G', fld_type_double },
+    { "Satellite", "satellite", 'n', fld_type_string },
+    { "Location", "location", 'L', fld_type_string },
+    { "Range rate", "range_rate", 'R', fld_type_double },
     { NULL }
 };    
 
+/* Times are in milliseconds since 1970, intervals in milliseconds */
+typedef struct {
+    observer obs;
+    long start;
+    int count;
+    long interval;
+    int millis;                 /* Set when times are shown with milliseconds */
+    output_plan *plan;
+    const char *satellite_name; /* Only used when streaming */
+    int rendered;               /* The number of observations rendered so far */
+    const tle_catalog *cat;     /* Not set when streaming */
+    const char *location_name;  /* The name of the location, without --overhead */
+    const location_list *locations; /* Only set with --overhead */
+    int min_elevation;          /* Only used with --overhead */
+} tracker;
+
+static void render_observation(tracker *t, const char *location_name, const char *name, long when,
+                               const observation *result) {
+    field_value values[sizeof fields/sizeof fields[0] - 1];
+    if(t->millis) {
+        values[0].value.time_ms_value = when;
+        values[1].value.time_ms_value = when;
+    } else {
+        values[0].value.time_value = when / 1000;
+        values[1].value.time_value = when / 1000;
+    }
+    values[2].value.double_value = result->range;
+    values[3].value.double_value = result->elevation;
+    values[4].value.double_value = result->azimuth;
+    values[5].value.double_value = result->ssp_lon;
+    values[6].value.double_value = result->ssp_lat;
+    values[7].value.double_value = result->altitude;
+    values[8].value.double_value = result->sat_eci[0];
+    values[9].value.double_value = result->sat_eci[1];
+    values[10].value.double_value = result->sat_eci[2];
+    values[11].value.double_value = result->velocity;
+    values[12].value.double_value = result->sat_velocity_eci[0];
+    values[13].value.double_value = result->sat_velocity_eci[1];
+    values[14].value.double_value = result->sat_velocity_eci[2];
+    values[15].value.double_value = result->groundtrack_velocity;
+    values[16].value.double_value = result->groundtrack_direction;
+    values[17].value.string_value = name ? name : "unknown";
+    values[18].value.string_value = location_name;
+    values[19].value.double_value = result->range_rate;
+    render(t->rendered++, t->plan, values);
+}
+
+static void track(tracker *t, const char *name, TLE *tle) {
+    long when = t->start;
+    observer_frame frame;
+
+    for(size_t l=0; l<t->count; l++) {
+        observation result;
+        if(l) advance_observer_frame(&frame, &frame, when);
+        else set_observer_frame(&t->obs, &frame, when);
+        observe_in_frame(&frame, &result, tle);
+        render_observation(t, t->location_name, name, when, &result);
+
+        when += t->interval;
+    }
+}
+
+/*
+ * Unless streaming, every selected satellite (just one without --all) is
+ * observed at every point in time. The points in time are handled in batches: first the observer frame of each point in
+ * time is calculated, then the satellites are divided over the threads, which
+ * each observe their satellites at all points in time of the batch, and
+ * finally the results are rendered in order of time and satellite.
+ */
+
+/* A batch contains at least this many observations, so that starting the
+   threads takes little time compared to the observations */
+#define BATCH_OBSERVATIONS (16384)
+
+typedef struct {
+    const char *name;
+    TLE *tle;
+    const tle_history *history; /* Only set with --history */
+    long valid_from, valid_until;
+} tracked_satellite;
+
+typedef struct {
+    const tracker *t;
+    tracked_satellite *satellites;
+    size_t nr_satellites;
+    const observer_frame *frames;
+    size_t nr_frames;
+    observation *results;       /* results[frame * nr_satellites + satellite] */
+} batch;
+
+typedef struct {
+    batch *b;
+    size_t first, last;
+} worker;
+
+/* With --history, makes sure that the satellite uses the TLE with the epoch
+   closest to the given time */
+static void select_tle(const tracker *t, tracked_satellite *sat, long when) {
+    if(sat->history && (when < sat->valid_from || when > sat->valid_until))
+        sat->tle = &t->cat->tles[get_tle_nearest_epoch(t->cat, sat->history, when,
+                                                       &sat->valid_from, &sat->valid_until)];
+}
+
+static void *observe_satellites(void *arg) {
+    worker *w = arg;
+    batch *b = w->b;
+    for(size_t s=w->first; s<w->last; s++) {
+        tracked_satellite *sat = &b->satellites[s];
+        for(size_t f=0; f<b->nr_frames; f++) {
+            select_tle(b->t, sat, b->frames[f].when);
+            observe_in_frame(&b->frames[f], &b->results[f * b->nr_satellites + s], sat->tle);
+        }
+    }
+    return NULL;
+}
+
+static int track_all(tracker *t, tracked_satellite *satellites, size_t nr_satellites, int nr_threads) {
+    size_t per_batch = BATCH_OBSERVATIONS / nr_satellites;
+    if(per_batch < 1) per_batch = 1;
+    if(per_batch > t->count) per_batch = t->count;
+    if(nr_threads > nr_satellites) nr_threads = nr_satellites;
+
+    observer_frame *frames = malloc(per_batch * sizeof(observer_frame));
+    observation *results = malloc(per_batch * nr_satellites * sizeof(observation));
+    worker *workers = malloc(nr_threads * sizeof(worker));
+    if(!frames || !results || !workers) {
+        free(frames);
+        free(results);
+        free(workers);
+        return -1;
+    }
+
+    batch b = { t, satellites, nr_satellites, frames, 0, results };
+    for(int l=0; l<nr_threads; l++) {
+        workers[l].b = &b;
+        workers[l].first = nr_satellites * l / nr_threads;
+        workers[l].last = nr_satellites * (l+1) / nr_threads;
+    }
+
+    long when = t->start;
+    for(size_t done=0; done<t->count; done+=b.nr_frames) {
+        b.nr_frames = t->count - done < per_batch ? t->count - done : per_batch;
+        /* The observer's location only needs to be converted for the first frame */
+        set_observer_frame(&t->obs, &frames[0], when);
+        for(size_t f=1; f<b.nr_frames; f++)
+            advance_observer_frame(&frames[f-1], &frames[f], when + (long)f * t->interval);
+
+        run_workers(workers, sizeof(worker), nr_threads, observe_satellites);
+
+        for(size_t f=0; f<b.nr_frames; f++)
+            for(size_t s=0; s<nr_satellites; s++)
+                render_observation(t, t->location_name, satellites[s].name, frames[f].when,
+                                   &results[f * nr_satellites + s]);
+        when += (long)b.nr_frames * t->interval;
+    }
+
+    free(frames);
+    free(results);
+    free(workers);
+    return 0;
+}
+
+/*
+ * With --overhead, all satellites are propagated once per point in time, and
+ * the footprints of those that did not fail are put in an index. From every
+ * location, only the satellites that the index gives as candidates are
+ * observed, and those at or above the minimum elevation are rendered, in
+ * order of time, location and satellite.
+ */
+
+/* The cells of the index are about this many degrees wide and high. Smaller
+   cells give fewer candidates, but take longer to fill */
+#define OVERHEAD_CELL_SIZE (10.0)
+
+static int track_overhead(tracker *t, tracked_satellite *satellites, size_t nr_satellites) {
+    const location_list *locations = t->locations;
+    double *states = malloc(nr_satellites * 6 * sizeof(double));
+    double *positions = malloc(nr_satellites * 3 * sizeof(double));
+    observer_frame *frames = malloc(locations->count * sizeof(observer_frame));
+    ssp_index *index = create_ssp_index(OVERHEAD_CELL_SIZE, t->min_elevation);
+    int result = -1;
+    if(!states || !positions || !frames || !index) goto out;
+
+    long when = t->start;
+    for(int l=0; l<t->count; l++, when += t->interval) {
+        for(size_t p=0; p<locations->count; p++) {
+            if(l) {
+                advance_observer_frame(&frames[p], &frames[p], when);
+            } else {
+                observer obs = { locations->locations[p].lon, locations->locations[p].lat, 0 };
+                set_observer_frame(&obs, &frames[p], when);
+            }
+        }
+
+        /* The position and velocity in ECI of every satellite, and its
+           position in ECEF for the index */
+        for(size_t s=0; s<nr_satellites; s++) {
+            double *sat_eci = &states[6 * s], *sat_velocity_eci = &states[6 * s + 3];
+            select_tle(t, &satellites[s], when);
+            getRVForDate(satellites[s].tle, when, sat_eci, sat_velocity_eci);
+            if(satellites[s].tle->sgp4Error)
+                positions[3 * s] = positions[3 * s + 1] = positions[3 * s + 2] = NAN;
+            else
+                eci_to_ecef_rotated(sat_eci, frames[0].cos_rotation, frames[0].sin_rotation, &positions[3 * s]);
+        }
+        if(build_ssp_index(index, positions, nr_satellites)) goto out;
+
+        for(size_t p=0; p<locations->count; p++) {
+            const unsigned int *candidates;
+            size_t nr_candidates = query_ssp_index(index, frames[p].obs_ecef, &candidates);
+            for(size_t c=0; c<nr_candidates; c++) {
+                size_t s = candidates[c];
+                observation o;
+                observe_position_in_frame(&frames[p], &o, &states[6 * s], &states[6 * s + 3]);
+                if(o.elevation >= t->min_elevation)
+                    render_observation(t, locations->locations[p].name, satellites[s].name, when, &o);
+            }
+        }
+    }
+    result = 0;
+
+out:
+    free(states);
+    free(positions);
+    free(frames);
+    free_ssp_index(index);
+    return result;
+}
+
+static int track_streamed(const char *name, TLE *tle, TLEInfo *info, void *arg) {
+    tracker *t = arg;
+    if(t->satellite_name && (!name || strcmp(name, t->satellite_name)))
+        return 0;
+    track(t, name, tle);
+    /* With a satellite name, only the first match is tracked */
+    return t->satellite_name ? 1 : 0;
+}
+
+/* Returns the satellites to track: with --all, all satellites in the catalog,
+   otherwise the one with the given name, or the first one. With --history, a
+   satellite uses all TLEs with its catalog number. Returns NULL and sets error
+   when no satellites are found */
+static tracked_satellite *select_satellites(tle_catalog *cat, const char *name, int all, int history,
+                                            size_t *nr_satellites, const char **error) {
+    *error = "Satellite not found";
+    size_t target = 0;
+    if(all) {
+        *error = "No satellites found";
+        if(!cat->count) return NULL;
+    } else if((target = get_tle_by_name(cat, name)) == TLE_NOT_FOUND) {
+        return NULL;
+    }
+    *error = "Failed to index TLE history";
+    if(history && index_tle_history(cat)) return NULL;
+
+    *nr_satellites = !all ? 1 : history ? cat->nr_histories : cat->count;
+    tracked_satellite *satellites = malloc(*nr_satellites * sizeof(tracked_satellite));
+    *error = "Out of memory";
+    if(!satellites) return NULL;
+
+    for(size_t l=0; l<*nr_satellites; l++) {
+        tracked_satellite *sat = &satellites[l];
+        if(!all) {
+            sat->name = cat->names[target];
+            sat->tle = &cat->tles[target];
+            sat->history = history ? get_tle_history(cat, target) : NULL;
+        } else if(history) {
+            /* One satellite per history, named after the first TLE with a name */
+            const tle_history *h = &cat->histories[l];
+            sat->history = h;
+            sat->name = NULL;
+            for(size_t e=0; e<h->count && !sat->name; e++)
+                sat->name = cat->names[h->entries[e]];
+        } else {
+            sat->history = NULL;
+            sat->name = cat->names[l];
+            sat->tle = &cat->tles[l];
+        }
+        /* Force a lookup in the history on the first observation */
+        sat->valid_from = 1;
+        sat->valid_until = 0;
+    }
+    return satellites;
+}
+
+/*
+ * With --follow, the satellites are observed at every multiple of the
+ * interval in wall-clock time, until the program is interrupted. The time of
+ * the next observation is always calculated from the schedule, rather than
+ * by sleeping for the interval, so that there is no drift. When observations
+ * take longer than the interval, the missed ones are skipped.
+ */
+
+typedef struct {
+    const char *file;
+    const selection *sel;
+    const char *satellite_name;
+    int all, history, nr_threads;
+    long interval;
+    tle_catalog *cat;
+    tracked_satellite *satellites;
+    size_t nr_satellites;
+} following;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int signal) {
+    interrupted = 1;
+}
+
+static long now_millis(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+/* Sleeps until the given time in milliseconds, returns non-zero when interrupted */
+static int sleep_until(long when) {
+    while(!interrupted) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        long long remaining = (long long)when * 1000 - ((long long)now.tv_sec * 1000000 + now.tv_usec);
+        if(remaining <= 0) return 0;
+        struct timespec duration = { remaining / 1000000, remaining % 1000000 * 1000 };
+        if(nanosleep(&duration, NULL) && errno != EINTR) return -1;
+    }
+    return -1;
+}
+
+/* Reloads the TLE file when it was modified since the last call. When the new
+   file can not be used, the old catalog is kept */
+static void reload_if_modified(tracker *t, following *f, struct stat *last) {
+    struct stat st;
+    if(!strcmp(f->file, "-") || stat(f->file, &st)) return;
+    if(st.st_mtime == last->st_mtime && st.st_size == last->st_size) return;
+    *last = st;
+
+    const char *error = "Failed to read file";
+    size_t nr_satellites;
+    tracked_satellite *satellites = NULL;
+    tle_catalog *cat = load_tles_from_filename((char *)f->file, f->sel);
+    if(cat) satellites = select_satellites(cat, f->satellite_name, f->all, f->history,
+                                           &nr_satellites, &error);
+    if(!satellites) {
+        fprintf(stderr, "Warning: %s after %s changed, continuing with the previous TLEs\n",
+                error, f->file);
+        unload_tles(cat);
+        return;
+    }
+    DEBUG("Reloaded %zu satellites from %s", nr_satellites, f->file);
+    free(f->satellites);
+    unload_tles(f->cat);
+    f->cat = cat;
+    t->cat = cat;
+    f->satellites = satellites;
+    f->nr_satellites = nr_satellites;
+}
+
+static int track_following(tracker *t, following *f) {
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = interrupt;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    struct stat last;
+    if(strcmp(f->file, "-") && stat(f->file, &last)) memset(&last, 0, sizeof last);
+
+    /* The first multiple of the interval that has not passed yet */
+    long now = now_millis();
+    long next = now - now % f->interval;
+    if(next < now) next += f->interval;
+
+    t->count = 1;
+    while(!sleep_until(next)) {
+        reload_if_modified(t, f, &last);
+        t->start = next;
+        if(t->locations ? track_overhead(t, f->satellites, f->nr_satellites) :
+                          track_all(t, f->satellites, f->nr_satellites, f->nr_threads)) {
+            fprintf(stderr, "Error: out of memory\n");
+            return EX_OSERR;
+        }
+        /* Every observation is shown immediately, also when not on a terminal */
+        output_flush();
+
+        now = now_millis();
+        next += f->interval;
+        if(next <= now) {
+            DEBUG("Skipping %ld observations", (now - next) / f->interval + 1);
+            next += ((now - next) / f->interval + 1) * f->interval;
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     executable = argv[0];
     opterr = 0;
@@ -108,29 +572,51 @@ int main(int argc, char *argv[]) {
         { "version", no_argument, NULL, 'V' },
         { "verbose", no_argument, NULL, 'v' },
         { "location", required_argument, NULL, 'l' },
+        { "locations", required_argument, NULL, 'L' },
+        { "min-elevation", required_argument, NULL, 'e' },
         { "start", required_argument, NULL, 's' },
         { "count", required_argument, NULL, 'c' },
         { "interval", required_argument, NULL, 'i' },
         { "satellite-name", required_argument, NULL, 'n' },
+        { "select", required_argument, NULL, 'S' },
         { "format", required_argument, NULL, 'f' },
         { "fields", required_argument, NULL, 'F' },
         { "headers", no_argument, NULL, 'H' },
+        { "stream", no_argument, NULL, OPT_STREAM },
+        { "history", no_argument, NULL, OPT_HISTORY },
+        { "all", no_argument, NULL, OPT_ALL },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "follow", optional_argument, NULL, OPT_FOLLOW },
+        { "overhead", no_argument, NULL, OPT_OVERHEAD },
         { NULL }
     };
 
     observer obs;
     obs.alt = 0;
     int has_location = 0;
-    struct timeval start;
-    gettimeofday(&start, 0);
-    start.tv_usec = 0;
+    location_list locations = { NULL, 0, 0 };
+    int has_locations_file = 0;
+    int min_elevation = 0, has_min_elevation = 0;
+    /* The current time, in whole seconds */
+    long start = now_millis() / 1000 * 1000;
     int count = 1;
-    int interval = 1;
+    long interval = 1000;
     char *satellite_name = NULL;
-    enum { fmt_auto, fmt_rows, fmt_cols } fmt = fmt_auto;
+    selection *sel = NULL;
+    output_format fmt;
+    int has_fmt = 0;
     char *selector = NULL;
     int headers = 0;
-    while((c = getopt_long(argc, argv, "hVvl:s:c:i:n:f:F:H", longopts, NULL)) != -1) {
+    int stream = 0;
+    int history = 0;
+    int all = 0;
+    int follow = 0;
+    int overhead = 0;
+    long follow_interval = 0;
+    int has_start = 0, has_count = 0;
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nr_threads = nr_cpus > 1 ? (int)nr_cpus : 1;
+    while((c = getopt_long(argc, argv, "hVvl:L:e:s:c:i:n:S:f:F:H", longopts, NULL)) != -1) {
         switch(c) {
             case 'h':
                 usage();
@@ -144,28 +630,47 @@ int main(int argc, char *argv[]) {
             case 'l':
                 if(optarg_as_lon_lat(&obs.lon, &obs.lat))
                     usage_error("Invalid location");          
+                if(add_location(&locations, optarg, obs.lat, obs.lon))
+                    usage_error("Out of memory");
                 has_location = 1;
                 break;
+            case 'L':
+                if(read_locations(&locations, optarg))
+                    usage_error("Failed to read locations");
+                has_location = has_locations_file = 1;
+                break;
+            case 'e':
+                if(optarg_as_int(&min_elevation, 0, 90))
+                    usage_error("Invalid elevation");
+                has_min_elevation = 1;
+                break;
             case 's':
-                if(optarg_as_datetime(&start.tv_sec))
+                if(optarg_as_datetime_millis(&start))
                     usage_error("Invalid start");
+                has_start = 1;
                 break;
             case 'c':
                 if(optarg_as_int(&count, 1, INT_MAX))
                     usage_error("Invalid count");
+                has_count = 1;
                 break;
             case 'i':
-                if(optarg_as_int(&interval, 1, INT_MAX))
+                if(optarg_as_millis(&interval, 1, INT_MAX * 1000L))
                     usage_error("Invalid interval");
                 break;
             case 'n':
                 free(satellite_name);
                 satellite_name = strdup(optarg);
                 break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
             case 'f':
-                if(string_starts_with("rows", optarg)) fmt = fmt_rows;
-                else if(string_starts_with("cols", optarg)) fmt = fmt_cols;
-                else usage_error("Invalid format");
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
+                has_fmt = 1;
                 break;
             case 'F':
                 if(check_selector(fields, optarg)) 
@@ -176,6 +681,27 @@ int main(int argc, char *argv[]) {
             case 'H':
                 headers = 1;
                 break;
+            case OPT_STREAM:
+                stream = 1;
+                break;
+            case OPT_HISTORY:
+                history = 1;
+                break;
+            case OPT_ALL:
+                all = 1;
+                break;
+            case OPT_OVERHEAD:
+                overhead = 1;
+                break;
+            case OPT_FOLLOW:
+                follow = 1;
+                if(optarg && optarg_as_millis(&follow_interval, 1, INT_MAX * 1000L))
+                    usage_error("Invalid follow interval");
+                break;
+            case OPT_THREADS:
+                if(optarg_as_int(&nr_threads, 1, 1024))
+                    usage_error("Invalid number of threads");
+                break;
             default:
                 usage_error("Invalid option");
                 break;
@@ -187,53 +713,96 @@ int main(int argc, char *argv[]) {
     else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
     else usage_error("either supply a file or set $ORBIT_TOOLS_TLE");
 
-    if(!selector)
-        selector = has_location ? "trlzoaA" : "toaA";
+    if(stream && history)
+        usage_error("--history can not be combined with --stream");
+    if(all && stream)
+        usage_error("--all can not be combined with --stream");
+    if(all && satellite_name)
+        usage_error("--all can not be combined with --satellite-name, use --select");
+    if(follow && (has_start || has_count || stream))
+        usage_error("--follow can not be combined with --start, --count or --stream");
+    if(overhead && (all || satellite_name || stream))
+        usage_error("--overhead can not be combined with --all, --satellite-name or --stream");
+    if(!overhead && (has_locations_file || has_min_elevation))
+        usage_error("--locations and --min-elevation can only be used with --overhead");
+    if(!locations.count && add_location(&locations, "0,0", 0, 0))
+        usage_error("Out of memory");
+    /* Without --overhead, the last location given is used */
+    const char *location_name = locations.locations[locations.count - 1].name;
 
-    if(fmt == fmt_auto) {
-        if(count > 1) fmt = fmt_cols;
-        else fmt = fmt_rows;
+    if(!selector) {
+        if(overhead) selector = strdup("tLnrlz");
+        else if(all) selector = strdup(has_location ? "ntrlzoaA" : "ntoaA");
+        else selector = strdup(has_location ? "trlzoaA" : "toaA");
     }
 
-    loaded_tle *lt = load_tles_from_filename(file);
-    if(!lt) usage_error("Failed to read file");
+    if(!has_fmt) {
+        if(count > 1 || all || follow || overhead) fmt = output_cols;
+        else fmt = output_rows;
+    }
 
-    loaded_tle *target_tle = get_tle_by_name(lt, satellite_name);
-    if(!target_tle) {
-        unload_tles(lt);
-        usage_error("Satellite not found");
+    if(!follow_interval) follow_interval = interval;
+    /* Times are only shown with milliseconds when needed */
+    int millis = start % 1000 || interval % 1000 || (follow && follow_interval % 1000);
+    if(millis) {
+        fields[0].type = fld_type_time_ms_string;
+        fields[1].type = fld_type_time_ms;
     }
 
-    TLE *tle = &target_tle->tle;
+    tracker t = { obs, start, count, interval, millis, plan_output(fields, selector, fmt),
+                  satellite_name, 0, NULL, location_name, overhead ? &locations : NULL, min_elevation };
+    free(selector);
 
-    if(fmt == fmt_cols && headers) render_headers(fields, selector);
+    if(stream) {
+        if(fmt == output_cols && headers) render_headers(t.plan);
+        if(read_tles_from_filename(file, sel, track_streamed, &t) < 0)
+            usage_error("Failed to read file");
+        if(!t.rendered) usage_error("Satellite not found");
+        close_output(t.plan);
+        exit(0);
+    }
 
-    field_value values[sizeof fields/sizeof fields[0] - 1];
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to read file");
 
-    for(size_t l=0; l<count; l++) {
-        observation result;
-        observe(&obs, &result, tle, start.tv_sec);
-        values[0].value.time_value = start.tv_sec;
-        values[1].value.time_value = start.tv_sec;
-        values[2].value.double_value = result.range;
-        values[3].value.double_value = result.elevation;
-        values[4].value.double_value = result.azimuth;
-        values[5].value.double_value = result.ssp_lon;
-        values[6].value.double_value = result.ssp_lat;
-        values[7].value.double_value = result.altitude;
-        values[8].value.double_value = result.sat_eci[0];
-        values[9].value.double_value = result.sat_eci[1];
-        values[10].value.double_value = result.sat_eci[2];
-        values[11].value.double_value = result.velocity;
-        values[12].value.double_value = result.sat_velocity_eci[0];
-        values[13].value.double_value = result.sat_velocity_eci[1];
-        values[14].value.double_value = result.sat_velocity_eci[2];
-        values[15].value.double_value = result.groundtrack_velocity;
-        values[16].value.double_value = result.groundtrack_direction;
-        render(l, fields, values, selector, fmt == fmt_rows);
-
-        start.tv_sec += interval;
-    }
-
-    unload_tles(lt);
+    const char *error;
+    size_t nr_satellites;
+    tracked_satellite *satellites = select_satellites(cat, satellite_name, all || overhead, history,
+                                                      &nr_satellites, &error);
+    if(!satellites) {
+        unload_tles(cat);
+        usage_error(error);
+    }
+    t.cat = cat;
+
+    if(fmt == output_cols && headers) render_headers(t.plan);
+
+    int result = 0;
+    if(follow) {
+        following f = { file, sel, satellite_name, all || overhead, history, nr_threads,
+                        follow_interval, cat, satellites, nr_satellites };
+        result = track_following(&t, &f);
+        cat = f.cat;
+        satellites = f.satellites;
+    } else if(overhead) {
+        /* The number of rows is not known in advance */
+        if(track_overhead(&t, satellites, nr_satellites)) {
+            fprintf(stderr, "Error: out of memory\n");
+            result = EX_OSERR;
+        }
+    } else {
+        t.plan->expected_rows = nr_satellites * count;
+        if(track_all(&t, satellites, nr_satellites, nr_threads)) {
+            fprintf(stderr, "Error: out of memory\n");
+            result = EX_OSERR;
+        }
+    }
+
+    free(satellites);
+    unload_tles(cat);
+    close_output(t.plan);
+    free_selection(sel);
+    free(satellite_name);
+    free_locations(&locations);
+    return result;
 }
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include "selection.h"
+
+static int is_number(const char *s, size_t len) {
+    if(!len) return 0;
+    for(size_t l=0; l<len; l++)
+        if(s[l] < '0' || s[l] > '9') return 0;
+    return 1;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int compare_ranges(const void *a, const void *b) {
+    const selection_range *ra = a, *rb = b;
+    return ra->first < rb->first ? -1 : ra->first > rb->first;
+}
+
+static int add_range(selection *sel, const char *term, size_t len) {
+    const char *dash = memchr(term, '-', len);
+    size_t first_len = dash ? dash - term : len;
+    if(!is_number(term, first_len) || (dash && !is_number(dash+1, len-first_len-1)))
+        return -1;
+    long first = strtol(term, NULL, 10),
+         last = dash ? strtol(dash+1, NULL, 10) : first;
+    if(first > INT_MAX || last > INT_MAX || last < first)
+        return -1;
+    sel->ranges[sel->nr_ranges].first = first;
+    sel->ranges[sel->nr_ranges].last = last;
+    sel->nr_ranges++;
+    return 0;
+}
+
+selection *parse_selection(const char *spec) {
+    size_t nr_terms = 1;
+    for(const char *p=spec; *p; p++)
+        if(*p == ',') nr_terms++;
+
+    selection *sel = calloc(1, sizeof(selection));
+    sel->names = malloc(nr_terms * sizeof(char *));
+    sel->patterns = malloc(nr_terms * sizeof(char *));
+    sel->ranges = malloc(nr_terms * sizeof(selection_range));
+
+    const char *term = spec;
+    for(;;) {
+        size_t len = strcspn(term, ",");
+        if(!len) {
+            free_selection(sel);
+            return NULL;
+        }
+        if(term[0] >= '0' && term[0] <= '9' && strspn(term, "0123456789-") >= len) {
+            if(add_range(sel, term, len)) {
+                free_selection(sel);
+                return NULL;
+            }
+        } else if(strcspn(term, "*?[") < len) {
+            sel->patterns[sel->nr_patterns++] = strndup(term, len);
+        } else {
+            sel->names[sel->nr_names++] = strndup(term, len);
+        }
+        if(!term[len]) break;
+        term += len + 1;
+    }
+
+    qsort(sel->names, sel->nr_names, sizeof(char *), compare_names);
+
+    /* Sort and merge the ranges so that a binary search finds the only candidate */
+    qsort(sel->ranges, sel->nr_ranges, sizeof(selection_range), compare_ranges);
+    size_t merged = 0;
+    for(size_t l=0; l<sel->nr_ranges; l++) {
+        if(merged && sel->ranges[l].first <= sel->ranges[merged-1].last + 1) {
+            if(sel->ranges[l].last > sel->ranges[merged-1].last)
+                sel->ranges[merged-1].last = sel->ranges[l].last;
+        } else {
+            sel->ranges[merged++] = sel->ranges[l];
+        }
+    }
+    sel->nr_ranges = merged;
+
+    return sel;
+}
+
+static int is_number_selected(const selection *sel, int catalog_number) {
+    size_t lo = 0, hi = sel->nr_ranges;
+    while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if(catalog_number < sel->ranges[mid].first) hi = mid;
+        else if(catalog_number > sel->ranges[mid].last) lo = mid + 1;
+        else return 1;
+    }
+    return 0;
+}
+
+int is_selected(const selection *sel, const char *name, int catalog_number) {
+    if(catalog_number >= 0 && is_number_selected(sel, catalog_number))
+        return 1;
+    if(!name)
+        return 0;
+    if(bsearch(&name, sel->names, sel->nr_names, sizeof(char *), compare_names))
+        return 1;
+    for(size_t l=0; l<sel->nr_patterns; l++)
+        if(!fnmatch(sel->patterns[l], name, 0))
+            return 1;
+    return 0;
+}
+
+void free_selection(selection *sel) {
+    if(!sel) return;
+    for(size_t l=0; l<sel->nr_names; l++)
+        free(sel->names[l]);
+    for(size_t l=0; l<sel->nr_patterns; l++)
+        free(sel->patterns[l]);
+    free(sel->names);
+    free(sel->patterns);
+    free(sel->ranges);
+    free(sel);
+}
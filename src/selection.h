@@ -0,0 +1,36 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <stddef.h>
+
+/*
+ * A selection of satellites, parsed from a comma-separated list of terms.
+ * Each term is one of:
+ * - a catalog number, like 25544
+ * - a range of catalog numbers, like 40000-40100 (inclusive)
+ * - a pattern containing *, ? or [...], like FLOCK*, as understood by fnmatch(3)
+ * - an exact satellite name
+ * A satellite is selected when it matches any of the terms.
+ */
+typedef struct {
+    int first, last;
+} selection_range;
+
+typedef struct {
+    size_t nr_names;
+    char **names;    /* Sorted, for binary searching */
+    size_t nr_patterns;
+    char **patterns;
+    size_t nr_ranges;
+    selection_range *ranges; /* Sorted and non-overlapping */
+} selection;
+
+/* Returns NULL if spec is invalid */
+selection *parse_selection(const char *spec);
+
+/* name may be NULL, catalog_number may be -1 when not known */
+int is_selected(const selection *sel, const char *name, int catalog_number);
+
+void free_selection(selection *sel);
+
+#endif
@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ssp_index.h"
+#include "constants.h"
+#include "util.h"
+
+/* No location on the ground is closer to the center of the earth */
+#define POLAR_RADIUS (WGS84_A * sqrt(1.0 - WGS84_E_SQUARED))
+
+/*
+ * The rows have equal heights, and the cells in a row equal widths, chosen
+ * so that the cells are about as wide as they are high. Cells are numbered
+ * from south to north and from west to east, starting at longitude -180.
+ * After building, the satellites in cell c are at satellites[cell_start[c]]
+ * up to satellites[cell_start[c+1]].
+ */
+struct ssp_index {
+    int nr_rows;
+    size_t first_built, last_built; /* The cells that are built, up to and including last_built */
+    int first_row, last_row;    /* The rows of those cells */
+    double row_height;          /* In radians */
+    unsigned int *first_cell;   /* For each row, the number of its first cell, and one beyond the last row */
+    double *cell_width;         /* For each row, the width of its cells in radians */
+    double *sin_lat, *cos_lat;  /* Of the center of the cells of each row */
+    double *radius;             /* For each row, the largest distance from the center of a cell to a point in it */
+    double *cos_radius, *sin_radius;
+    double max_radius;
+    double min_elevation, cos_min_elevation;
+    size_t nr_cells;
+    unsigned int *cell_start;
+    unsigned int *satellites;
+    size_t satellites_size;
+    unsigned int *pairs;        /* Cell and satellite of every footprint cell found while building */
+    size_t nr_pairs, pairs_size;
+};
+
+/* The angle between two points on a sphere, the first at longitude 0 */
+static double distance(double lat1, double lat2, double lon2) {
+    double cos_d = sin(lat1) * sin(lat2) + cos(lat1) * cos(lat2) * cos(lon2);
+    return acos(cos_d > 1.0 ? 1.0 : cos_d < -1.0 ? -1.0 : cos_d);
+}
+
+/* The largest distance from the center of a cell to a point in it, which
+   is at a corner, or on the western or eastern edge where the distance to
+   that edge is largest */
+static double cell_radius(double lat, double height, double width) {
+    double south = lat - height / 2, north = lat + height / 2;
+    double radius = fmax(distance(lat, south, width / 2), distance(lat, north, width / 2));
+    double extreme = atan2(sin(lat), cos(lat) * cos(width / 2));
+    if(extreme > south && extreme < north)
+        radius = fmax(radius, distance(lat, extreme, width / 2));
+    return radius;
+}
+
+ssp_index *create_ssp_index(double cell_size, double min_elevation) {
+    ssp_index *index = calloc(1, sizeof(ssp_index));
+    if(!index) return NULL;
+    index->nr_rows = (int)ceil(180.0 / cell_size);
+    if(index->nr_rows < 1) index->nr_rows = 1;
+    index->row_height = M_PI / index->nr_rows;
+    index->first_cell = malloc((index->nr_rows + 1) * sizeof(unsigned int));
+    index->cell_width = malloc(index->nr_rows * sizeof(double));
+    index->sin_lat = malloc(index->nr_rows * sizeof(double));
+    index->cos_lat = malloc(index->nr_rows * sizeof(double));
+    index->radius = malloc(index->nr_rows * sizeof(double));
+    index->cos_radius = malloc(index->nr_rows * sizeof(double));
+    index->sin_radius = malloc(index->nr_rows * sizeof(double));
+    if(!index->first_cell || !index->cell_width || !index->sin_lat || !index->cos_lat || !index->radius ||
+       !index->cos_radius || !index->sin_radius) {
+        free_ssp_index(index);
+        return NULL;
+    }
+
+    unsigned int nr_cells = 0;
+    for(int row=0; row<index->nr_rows; row++) {
+        double lat = -M_PI/2 + (row + 0.5) * index->row_height;
+        int nr_cols = (int)round(2 * M_PI * cos(lat) / index->row_height);
+        if(nr_cols < 1) nr_cols = 1;
+        index->first_cell[row] = nr_cells;
+        index->cell_width[row] = 2 * M_PI / nr_cols;
+        index->sin_lat[row] = sin(lat);
+        index->cos_lat[row] = cos(lat);
+        index->radius[row] = cell_radius(lat, index->row_height, index->cell_width[row]);
+        index->cos_radius[row] = cos(index->radius[row]);
+        index->sin_radius[row] = sin(index->radius[row]);
+        if(index->radius[row] > index->max_radius) index->max_radius = index->radius[row];
+        nr_cells += nr_cols;
+    }
+    index->first_cell[index->nr_rows] = nr_cells;
+    index->nr_cells = nr_cells;
+    index->first_built = 0;
+    index->last_built = nr_cells - 1;
+    index->first_row = 0;
+    index->last_row = index->nr_rows - 1;
+    index->cell_start = calloc(nr_cells + 1, sizeof(unsigned int));
+    if(!index->cell_start) {
+        free_ssp_index(index);
+        return NULL;
+    }
+    index->min_elevation = deg_to_rad(min_elevation);
+    index->cos_min_elevation = cos(index->min_elevation);
+    return index;
+}
+
+static int add_cells(ssp_index *index, unsigned int satellite, int row, long first_col, long last_col) {
+    long nr_cols = index->first_cell[row+1] - index->first_cell[row];
+    /* A range that wraps around the antimeridian is added in two parts */
+    if(first_col < 0)
+        return add_cells(index, satellite, row, first_col + nr_cols, nr_cols - 1) ||
+               add_cells(index, satellite, row, 0, last_col);
+    if(last_col >= nr_cols)
+        return add_cells(index, satellite, row, first_col, nr_cols - 1) ||
+               add_cells(index, satellite, row, 0, last_col - nr_cols);
+    long first_built = (long)index->first_built - (long)index->first_cell[row];
+    long last_built = (long)index->last_built - (long)index->first_cell[row];
+    if(first_col < first_built) first_col = first_built;
+    if(last_col > last_built) last_col = last_built;
+    if(last_col < first_col) return 0;
+    if(index->nr_pairs + (last_col - first_col + 1) > index->pairs_size) {
+        size_t size = index->pairs_size ? index->pairs_size * 2 : 4096;
+        while(size < index->nr_pairs + (last_col - first_col + 1)) size *= 2;
+        unsigned int *pairs = realloc(index->pairs, size * 2 * sizeof(unsigned int));
+        if(!pairs) return -1;
+        index->pairs = pairs;
+        index->pairs_size = size;
+    }
+    for(long col=first_col; col<=last_col; col++) {
+        index->pairs[2 * index->nr_pairs] = index->first_cell[row] + col;
+        index->pairs[2 * index->nr_pairs + 1] = satellite;
+        index->nr_pairs++;
+    }
+    return 0;
+}
+
+/* Adds the cells with a point within cap of the sub-satellite point: those
+   with their center within cap plus the radius of the cells */
+static int add_footprint(ssp_index *index, unsigned int satellite, const double position[3], double r, double cap) {
+    double ssp_lat = asin(position[2] / r);
+    int first_row = (int)floor((ssp_lat - cap - index->max_radius + M_PI/2) / index->row_height);
+    int last_row = (int)floor((ssp_lat + cap + index->max_radius + M_PI/2) / index->row_height);
+    if(first_row < index->first_row) first_row = index->first_row;
+    if(last_row > index->last_row) last_row = index->last_row;
+    if(first_row > last_row) return 0;
+
+    double cos_cap = cos(cap), sin_cap = sin(cap);
+    double ssp_lon = atan2(position[1], position[0]);
+    double sin_ssp_lat = sin(ssp_lat), cos_ssp_lat = cos(ssp_lat);
+
+    for(int row=first_row; row<=last_row; row++) {
+        long nr_cols = index->first_cell[row+1] - index->first_cell[row];
+        double reach = cap + index->radius[row];
+        if(reach >= M_PI) {
+            if(add_cells(index, satellite, row, 0, nr_cols - 1)) return -1;
+            continue;
+        }
+        double cos_reach = cos_cap * index->cos_radius[row] - sin_cap * index->sin_radius[row];
+        double denominator = index->cos_lat[row] * cos_ssp_lat;
+        double cos_half_width = denominator > 1e-12 ?
+            (cos_reach - index->sin_lat[row] * sin_ssp_lat) / denominator : -2.0;
+        if(cos_half_width > 1.0) continue;
+        if(cos_half_width <= -1.0) {
+            /* The reach contains a pole, or the sub-satellite point is at a pole */
+            if(denominator <= 1e-12 && index->sin_lat[row] * sin_ssp_lat < cos_reach) continue;
+            if(add_cells(index, satellite, row, 0, nr_cols - 1)) return -1;
+            continue;
+        }
+        double half_width = acos(cos_half_width);
+        double width = index->cell_width[row];
+        long first_col = (long)ceil((ssp_lon - half_width + M_PI) / width - 0.5);
+        long last_col = (long)floor((ssp_lon + half_width + M_PI) / width - 0.5);
+        if(last_col < first_col) continue;
+        if(last_col - first_col + 1 >= nr_cols) {
+            first_col = 0;
+            last_col = nr_cols - 1;
+        }
+        if(add_cells(index, satellite, row, first_col, last_col)) return -1;
+    }
+    return 0;
+}
+
+int build_ssp_index(ssp_index *index, const double *positions, size_t nr_positions) {
+    index->nr_pairs = 0;
+    for(size_t s=0; s<nr_positions; s++) {
+        const double *position = &positions[3 * s];
+        double r = vec3_len(position);
+        if(!(r > 0)) continue;
+        /* The earth central angle between the sub-satellite point and the edge
+           of the footprint */
+        double cos_nadir = POLAR_RADIUS / r * index->cos_min_elevation;
+        if(cos_nadir >= 1.0) continue;
+        double cap = acos(cos_nadir) - index->min_elevation;
+        if(cap <= 0) continue;
+        if(add_footprint(index, s, position, r, cap)) return -1;
+    }
+
+    if(index->nr_pairs > index->satellites_size) {
+        unsigned int *satellites = realloc(index->satellites, index->nr_pairs * sizeof(unsigned int));
+        if(!satellites) return -1;
+        index->satellites = satellites;
+        index->satellites_size = index->nr_pairs;
+    }
+
+    /* Sort the satellites by cell, keeping them in order within a cell. First
+       cell_start[c] is set to the end of cell c, and it moves back to the
+       start while the satellites are filled in from the end. Only the cells
+       that are built take part */
+    unsigned int *cell_start = index->cell_start;
+    size_t first = index->first_built, last = index->last_built + 1;
+    memset(cell_start + first, 0, (last - first + 1) * sizeof(unsigned int));
+    for(size_t p=0; p<index->nr_pairs; p++) cell_start[index->pairs[2 * p]]++;
+    for(size_t c=first+1; c<=last; c++) cell_start[c] += cell_start[c-1];
+    for(size_t p=index->nr_pairs; p>0; p--)
+        index->satellites[--cell_start[index->pairs[2 * (p-1)]]] = index->pairs[2 * (p-1) + 1];
+    return 0;
+}
+
+/* Returns the row that contains the given cell */
+static int cell_row(const ssp_index *index, size_t cell) {
+    int row = 0;
+    while(row < index->nr_rows - 1 && index->first_cell[row+1] <= cell) row++;
+    return row;
+}
+
+void restrict_ssp_index(ssp_index *index, size_t first_cell, size_t last_cell) {
+    index->first_built = first_cell;
+    index->last_built = last_cell;
+    index->first_row = cell_row(index, first_cell);
+    index->last_row = cell_row(index, last_cell);
+}
+
+size_t ssp_index_cell(const ssp_index *index, const double location[3]) {
+    double r = vec3_len(location);
+    double lat = asin(location[2] / r);
+    double lon = atan2(location[1], location[0]);
+    int row = (int)floor((lat + M_PI/2) / index->row_height);
+    if(row < 0) row = 0;
+    if(row >= index->nr_rows) row = index->nr_rows - 1;
+    long nr_cols = index->first_cell[row+1] - index->first_cell[row];
+    long col = (long)floor((lon + M_PI) / index->cell_width[row]);
+    if(col < 0) col = 0;
+    if(col >= nr_cols) col = nr_cols - 1;
+    return index->first_cell[row] + col;
+}
+
+size_t query_ssp_index_cell(const ssp_index *index, size_t cell, const unsigned int **satellites) {
+    if(cell < index->first_built || cell > index->last_built) {
+        *satellites = index->satellites;
+        return 0;
+    }
+    *satellites = &index->satellites[index->cell_start[cell]];
+    return index->cell_start[cell+1] - index->cell_start[cell];
+}
+
+size_t query_ssp_index(const ssp_index *index, const double location[3], const unsigned int **satellites) {
+    return query_ssp_index_cell(index, ssp_index_cell(index, location), satellites);
+}
+
+void free_ssp_index(ssp_index *index) {
+    if(!index) return;
+    free(index->first_cell);
+    free(index->cell_width);
+    free(index->sin_lat);
+    free(index->cos_lat);
+    free(index->radius);
+    free(index->cos_radius);
+    free(index->sin_radius);
+    free(index->cell_start);
+    free(index->satellites);
+    free(index->pairs);
+    free(index);
+}
@@ -0,0 +1,49 @@
+#ifndef SSP_INDEX_H
+#define SSP_INDEX_H
+
+#include <stddef.h>
+
+/*
+ * A spatial index of the footprints of satellites at one moment: the caps
+ * around their sub-satellite points from which they are visible with at
+ * least a minimum elevation. The earth is divided into rows of cells of
+ * roughly equal area, and every cell lists the satellites whose footprint
+ * may reach into it. Finding the satellites that may be visible from a
+ * location then only takes looking up the cell it is in, after which just
+ * those candidates need to be observed. The footprints are calculated for
+ * an earth as small as the WGS84 polar radius, so the candidates always
+ * include the satellites that are visible.
+ */
+typedef struct ssp_index ssp_index;
+
+/* Creates an index with cells of about cell_size by cell_size degrees, for
+   the given minimum elevation in degrees. Returns NULL when out of memory */
+ssp_index *create_ssp_index(double cell_size, double min_elevation);
+
+/* Replaces the contents of the index by the satellites at the given ECEF
+   positions, as x, y, z in km for each satellite. Satellites with a NAN
+   coordinate are left out. Returns non-zero when out of memory */
+int build_ssp_index(ssp_index *index, const double *positions, size_t nr_positions);
+
+/* Sets satellites to the candidates for the location at the given ECEF
+   position, in increasing order of satellite number, and returns their
+   number. They stay valid until the index is built again */
+size_t query_ssp_index(const ssp_index *index, const double location[3], const unsigned int **satellites);
+
+/* Returns the number of the cell that contains the location at the given ECEF
+   position. Cells stay the same when the index is built again, so locations
+   that do not move only need to be looked up once */
+size_t ssp_index_cell(const ssp_index *index, const double location[3]);
+
+/* Like query_ssp_index, for the locations in the given cell */
+size_t query_ssp_index_cell(const ssp_index *index, size_t cell, const unsigned int **satellites);
+
+/* Only puts satellites in the cells from first_cell up to and including
+   last_cell from now on, leaving the other cells empty. Threads that each
+   handle the locations of a range of cells can then build just the part of
+   the index they need */
+void restrict_ssp_index(ssp_index *index, size_t first_cell, size_t last_cell);
+
+void free_ssp_index(ssp_index *index);
+
+#endif
@@ -0,0 +1,35 @@
+#include <math.h>
+#include "sun.h"
+#include "constants.h"
+#include "util.h"
+
+#define AU (149597870.7) /* In km */
+
+void sun_position(long when, double position[3]) {
+    double days = (when / 1000.0 - J2000) / 86400.0;
+    double mean_longitude = deg_to_rad(280.460 + 0.9856474 * days);
+    double mean_anomaly = deg_to_rad(357.528 + 0.9856003 * days);
+    double longitude = mean_longitude + deg_to_rad(1.915 * sin(mean_anomaly) + 0.020 * sin(2 * mean_anomaly));
+    double obliquity = deg_to_rad(23.439 - 0.0000004 * days);
+    double distance = (1.00014 - 0.01671 * cos(mean_anomaly) - 0.00014 * cos(2 * mean_anomaly)) * AU;
+    position[0] = distance * cos(longitude);
+    position[1] = distance * cos(obliquity) * sin(longitude);
+    position[2] = distance * sin(obliquity) * sin(longitude);
+}
+
+/* Compares the apparent radii of the sun and the earth, seen from the
+   satellite, with the angle between their centers */
+shadow get_shadow(const double sat_eci[3], const double sun_eci[3]) {
+    double to_sun[3], to_earth[3];
+    vec3_sub(sun_eci, sat_eci, to_sun);
+    vec3_scalar_mult(sat_eci, -1, to_earth);
+    double sun_distance = vec3_len(to_sun), earth_distance = vec3_len(to_earth);
+    if(earth_distance <= WGS84_A) return shadow_umbra;
+    double sun_radius = asin(SUN_RADIUS / sun_distance);
+    double earth_radius = asin(WGS84_A / earth_distance);
+    double cos_separation = dot_product(to_sun, to_earth) / (sun_distance * earth_distance);
+    double separation = acos(cos_separation > 1 ? 1 : cos_separation < -1 ? -1 : cos_separation);
+    if(separation >= sun_radius + earth_radius) return shadow_none;
+    if(separation <= earth_radius - sun_radius) return shadow_umbra;
+    return shadow_penumbra;
+}
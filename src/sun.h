@@ -0,0 +1,28 @@
+#ifndef SUN_H
+#define SUN_H
+
+/*
+ * The position of the sun, from the low precision formulas of the
+ * Astronomical Almanac, which are accurate to about 0.01 degrees between
+ * 1950 and 2050. That is more than enough to tell whether a satellite is in
+ * the shadow of the earth, or whether the sun is up somewhere.
+ */
+
+#define SUN_RADIUS (696000.0) /* In km */
+
+/* Sets position to that of the sun in ECI, in km, at the given time in
+   milliseconds since 1970 */
+void sun_position(long when, double position[3]);
+
+typedef enum {
+    shadow_none,
+    shadow_penumbra,
+    shadow_umbra
+} shadow;
+
+/* Returns the shadow that a satellite at the given position in ECI is in,
+   for the sun at the given position. The shadow of the earth is modelled
+   as cones around a sphere with the equatorial radius */
+shadow get_shadow(const double sat_eci[3], const double sun_eci[3]);
+
+#endif
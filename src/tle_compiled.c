@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tle_compiled.h"
+#include "debug.h"
+
+/* Arrays start at an offset that is a multiple of this, so the doubles in
+   the mapped structs are properly aligned */
+#define RECORD_ALIGNMENT (16)
+
+int is_compiled_tle_header(const void *buf, size_t len) {
+    return len >= sizeof TLE_COMPILED_MAGIC &&
+           !memcmp(buf, TLE_COMPILED_MAGIC, sizeof TLE_COMPILED_MAGIC);
+}
+
+static uint64_t align(uint64_t offset) {
+    return (offset + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+}
+
+static int write_padding(FILE *out, size_t len) {
+    static const char zeroes[RECORD_ALIGNMENT];
+    return fwrite(zeroes, 1, len, out) == len ? 0 : -1;
+}
+
+int write_compiled_tles(FILE *out, const tle_catalog *cat) {
+    tle_compiled_header header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, TLE_COMPILED_MAGIC, sizeof TLE_COMPILED_MAGIC);
+    header.version = TLE_COMPILED_VERSION;
+    header.byte_order = TLE_COMPILED_BYTE_ORDER;
+    header.tle_size = sizeof(TLE);
+    header.info_size = sizeof(TLEInfo);
+    header.count = cat->count;
+    header.tles_offset = align(sizeof header);
+    header.info_offset = align(header.tles_offset + header.count * sizeof(TLE));
+    header.catalog_numbers_offset = align(header.info_offset + header.count * sizeof(TLEInfo));
+    header.name_offsets_offset = align(header.catalog_numbers_offset + header.count * sizeof(int32_t));
+    header.names_offset = header.name_offsets_offset + header.count * sizeof(uint64_t);
+    for(size_t l=0; l<cat->count; l++)
+        if(cat->names[l]) header.names_size += strlen(cat->names[l]) + 1;
+
+    if(fwrite(&header, sizeof header, 1, out) != 1) return -1;
+    if(write_padding(out, header.tles_offset - sizeof header)) return -1;
+
+    if(fwrite(cat->tles, sizeof(TLE), cat->count, out) != cat->count) return -1;
+    if(write_padding(out, header.info_offset - (header.tles_offset + header.count * sizeof(TLE)))) return -1;
+    if(fwrite(cat->info, sizeof(TLEInfo), cat->count, out) != cat->count) return -1;
+    if(write_padding(out, header.catalog_numbers_offset - (header.info_offset + header.count * sizeof(TLEInfo)))) return -1;
+    for(size_t l=0; l<cat->count; l++) {
+        int32_t number = cat->catalog_numbers[l];
+        if(fwrite(&number, sizeof number, 1, out) != 1) return -1;
+    }
+    if(write_padding(out, header.name_offsets_offset - (header.catalog_numbers_offset + header.count * sizeof(int32_t)))) return -1;
+
+    uint64_t name_offset = 0;
+    for(size_t l=0; l<cat->count; l++) {
+        uint64_t offset = TLE_COMPILED_NO_NAME;
+        if(cat->names[l]) {
+            offset = name_offset;
+            name_offset += strlen(cat->names[l]) + 1;
+        }
+        if(fwrite(&offset, sizeof offset, 1, out) != 1) return -1;
+    }
+
+    for(size_t l=0; l<cat->count; l++)
+        if(cat->names[l] && fwrite(cat->names[l], strlen(cat->names[l]) + 1, 1, out) != 1) return -1;
+
+    return fflush(out) ? -1 : 0;
+}
+
+static int check_header(const tle_compiled_header *header, size_t file_size) {
+    if(!is_compiled_tle_header(header, sizeof *header)) {
+        DEBUG("Not a compiled TLE catalog");
+        return -1;
+    }
+    if(header->version != TLE_COMPILED_VERSION ||
+       header->byte_order != TLE_COMPILED_BYTE_ORDER ||
+       header->tle_size != sizeof(TLE) ||
+       header->info_size != sizeof(TLEInfo)) {
+        DEBUG("Compiled TLE catalog is incompatible (version %u, TLE size %u), recompile it",
+              header->version, header->tle_size);
+        return -1;
+    }
+    if(header->tles_offset % RECORD_ALIGNMENT ||
+       header->info_offset % RECORD_ALIGNMENT ||
+       header->catalog_numbers_offset % RECORD_ALIGNMENT ||
+       header->tles_offset + header->count * sizeof(TLE) > header->info_offset ||
+       header->info_offset + header->count * sizeof(TLEInfo) > header->catalog_numbers_offset ||
+       header->catalog_numbers_offset + header->count * sizeof(int32_t) > header->name_offsets_offset ||
+       header->name_offsets_offset + header->count * sizeof(uint64_t) > header->names_offset ||
+       header->names_offset + header->names_size > file_size) {
+        DEBUG("Compiled TLE catalog is truncated");
+        return -1;
+    }
+    return 0;
+}
+
+tle_catalog *load_compiled_tles(const char *filename, const selection *sel) {
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st) || st.st_size < sizeof(tle_compiled_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    /* The mapping is private and writable, because propagating a TLE updates
+       its ElsetRec. Only the pages that are actually written get copied */
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return NULL;
+
+    const tle_compiled_header *header = map;
+    tle_catalog *cat = NULL;
+    if(check_header(header, st.st_size) ||
+       !(cat = calloc(1, sizeof(tle_catalog))) ||
+       !(cat->names = malloc((header->count ? header->count : 1) * sizeof(char *)))) {
+        free(cat);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    cat->map = map;
+    cat->map_size = st.st_size;
+    cat->count = header->count;
+    cat->tles = (TLE *)((char *)map + header->tles_offset);
+    cat->info = (TLEInfo *)((char *)map + header->info_offset);
+    cat->catalog_numbers = (int *)((char *)map + header->catalog_numbers_offset);
+
+    const uint64_t *name_offsets = (const uint64_t *)((char *)map + header->name_offsets_offset);
+    char *names = (char *)map + header->names_offset;
+    for(size_t l=0; l<cat->count; l++) {
+        /* This includes TLE_COMPILED_NO_NAME */
+        if(name_offsets[l] >= header->names_size ||
+           !memchr(&names[name_offsets[l]], 0, header->names_size - name_offsets[l]))
+            cat->names[l] = NULL;
+        else
+            cat->names[l] = &names[name_offsets[l]];
+    }
+
+    if(sel) {
+        size_t selected = 0;
+        for(size_t l=0; l<cat->count; l++)
+            if(is_selected(sel, cat->names[l], cat->catalog_numbers[l]))
+                selected++;
+        TLE *tles = malloc((selected ? selected : 1) * sizeof(TLE));
+        TLEInfo *info = malloc((selected ? selected : 1) * sizeof(TLEInfo));
+        int *numbers = malloc((selected ? selected : 1) * sizeof(int));
+        if(!tles || !info || !numbers) {
+            free(tles);
+            free(info);
+            free(numbers);
+            unload_tles(cat);
+            return NULL;
+        }
+        selected = 0;
+        for(size_t l=0; l<cat->count; l++) {
+            if(is_selected(sel, cat->names[l], cat->catalog_numbers[l])) {
+                memcpy(&tles[selected], &cat->tles[l], sizeof(TLE));
+                memcpy(&info[selected], &cat->info[l], sizeof(TLEInfo));
+                numbers[selected] = cat->catalog_numbers[l];
+                cat->names[selected] = cat->names[l];
+                selected++;
+            }
+        }
+        cat->tles = tles;
+        cat->info = info;
+        cat->catalog_numbers = numbers;
+        cat->count = selected;
+    }
+
+    index_tles(cat);
+    return cat;
+}
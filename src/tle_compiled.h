@@ -0,0 +1,55 @@
+#ifndef TLE_COMPILED_H
+#define TLE_COMPILED_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "tle_loader.h"
+
+/*
+ * A compiled TLE catalog is a binary file containing fully initialized
+ * TLE structs (that is, sgp4init has already been run on them), followed by
+ * their TLEInfo structs, catalog numbers and the satellite names. Loading it
+ * only requires mapping the file, there is no parsing involved. Since the
+ * arrays are stored apart, only the pages with the TLE structs are read when
+ * propagating.
+ *
+ * The TLE structs are stored as-is, so a compiled catalog can only be used
+ * by executables built from the same sources on the same architecture. The
+ * header contains enough information to detect a mismatch.
+ */
+
+#define TLE_COMPILED_MAGIC "OTCATLG"
+#define TLE_COMPILED_VERSION (3)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;  /* TLE_COMPILED_BYTE_ORDER as written by the host */
+    uint32_t tle_size;    /* sizeof(TLE) */
+    uint32_t info_size;   /* sizeof(TLEInfo) */
+    uint64_t count;       /* Number of TLEs */
+    uint64_t tles_offset; /* Start of the array of count TLE structs */
+    uint64_t info_offset; /* Start of the array of count TLEInfo structs */
+    uint64_t catalog_numbers_offset; /* Start of the array of count int32_t's */
+    uint64_t name_offsets_offset; /* Start of the array of count uint64_t's */
+    uint64_t names_offset;
+    uint64_t names_size;
+} tle_compiled_header;
+
+#define TLE_COMPILED_BYTE_ORDER (0x01020304)
+/* Name offsets are relative to names_offset, this is used for TLEs without a name */
+#define TLE_COMPILED_NO_NAME (UINT64_MAX)
+
+/* Returns non-zero if the header starts with the magic of a compiled catalog */
+int is_compiled_tle_header(const void *buf, size_t len);
+
+/* Writes all TLEs in cat as a compiled catalog to out. Returns 0 on success */
+int write_compiled_tles(FILE *out, const tle_catalog *cat);
+
+/* Maps the compiled catalog in filename. The TLEs in the returned catalog point
+   directly into the (private) mapping. Returns NULL on failure, including when
+   the catalog was compiled by an incompatible executable. When sel is not NULL,
+   the selected TLEs are copied out of the mapping instead */
+tle_catalog *load_compiled_tles(const char *filename, const selection *sel);
+
+#endif
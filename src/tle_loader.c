@@ -1,91 +1,401 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "tle_loader.h"
+#include "tle_compiled.h"
 
-loaded_tle *load_tles(FILE *in) {
-    loaded_tle *lt = NULL;
-    loaded_tle **tail = &lt;
-    char *name = NULL, *line1 = NULL;
+#define INITIAL_CAPACITY (64)
+
+/* The longest line that is accepted as a satellite name */
+#define MAX_NAME_LENGTH (24)
+
+int read_tles(FILE *in, const selection *sel, tle_handler handler, void *arg) {
+    /* Only the current line, the last line1 and the last name are kept, so memory
+       use does not depend on the size of the input */
+    char name[MAX_NAME_LENGTH+1], line1[70];
+    int has_name = 0, has_line1 = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    TLE tle;
+    TLEInfo info;
+    int result = 0;
     for(;;) {
-        char *line = NULL;
-        size_t cap;
-        ssize_t result = getline(&line, &cap, in);
-        if(result < 0) break;
-        for(ssize_t l=result-1; l >= 0 && line[l] <= 0x20; l--) line[l] = 0;
-        if(line1 && strlen(line) == 69 && strstr(line, "2 ") == line) {
+        ssize_t len = getline(&line, &cap, in);
+        if(len < 0) break;
+        for(ssize_t l=len-1; l >= 0 && line[l] <= 0x20; l--) line[l] = 0;
+        len = strlen(line);
+        if(has_line1 && len == 69 && strstr(line, "2 ") == line) {
             /* We have a line1, possibly a name and this looks like a line2 */
-            loaded_tle *next = malloc(sizeof(loaded_tle));
-            next->name = name;
-            parseLines(&next->tle, line1, line);
-            free(line1);
-            line1 = NULL; name = NULL;
-            *tail = next;
-            tail = &next->next;
-            next->next = NULL;
-        } else if(strlen(line) == 69 && strstr(line, "1 ") == line) {
+            if(!sel || is_selected(sel, has_name ? name : NULL, tle_catalog_number(&line1[2]))) {
+                parseLines(&tle, &info, line1, line);
+                result = handler(has_name ? name : NULL, &tle, &info, arg);
+            }
+            has_line1 = has_name = 0;
+            if(result) break;
+        } else if(len == 69 && strstr(line, "1 ") == line) {
             /* This looks like a line1, we may also have a name */
-            line1 = line;
+            memcpy(line1, line, sizeof line1);
+            has_line1 = 1;
         } else {
-            free(name);
-            free(line1);
-            line1 = NULL; name = NULL;
-            if(strlen(line) <= 24) 
-                name = line;
+            has_line1 = 0;
+            has_name = len <= MAX_NAME_LENGTH;
+            if(has_name) memcpy(name, line, len+1);
         }
     }
-    free(name);
-    free(line1);
+    free(line);
 
-    if(feof(in)) {
-        return lt;
-    } else {
-        unload_tles(lt);
+    if(!result && !feof(in)) result = -1;
+    return result;
+}
+
+/* Resizes all arrays in cat to the given capacity, which may also be used to shrink them */
+static int reserve_tles(tle_catalog *cat, size_t capacity) {
+    TLE *tles = realloc(cat->tles, capacity * sizeof(TLE));
+    if(!tles) return -1;
+    cat->tles = tles;
+    TLEInfo *info = realloc(cat->info, capacity * sizeof(TLEInfo));
+    if(!info) return -1;
+    cat->info = info;
+    char **names = realloc(cat->names, capacity * sizeof(char *));
+    if(!names) return -1;
+    cat->names = names;
+    int *numbers = realloc(cat->catalog_numbers, capacity * sizeof(int));
+    if(!numbers) return -1;
+    cat->catalog_numbers = numbers;
+    cat->capacity = capacity;
+    return 0;
+}
+
+/* Returns the maximum number of TLEs in the file, or 0 if that is not known */
+static size_t max_tles_in_file(FILE *in) {
+    struct stat st;
+    if(fstat(fileno(in), &st) || !S_ISREG(st.st_mode)) return 0;
+    /* Every TLE has two lines of 69 characters, separated by at least one newline */
+    return st.st_size / 139 + 1;
+}
+
+static int append_tle(const char *name, TLE *tle, TLEInfo *info, void *arg) {
+    tle_catalog *cat = arg;
+    if(cat->count == cat->capacity &&
+       reserve_tles(cat, cat->capacity ? cat->capacity * 2 : INITIAL_CAPACITY))
+        return -1;
+    memcpy(&cat->tles[cat->count], tle, sizeof(TLE));
+    memcpy(&cat->info[cat->count], info, sizeof(TLEInfo));
+    cat->names[cat->count] = NULL;
+    if(name && !(cat->names[cat->count] = arena_strdup(&cat->strings, name)))
+        return -1;
+    cat->catalog_numbers[cat->count] = tle_catalog_number(info->objectID);
+    cat->count++;
+    return 0;
+}
+
+tle_catalog *load_tles(FILE *in, const selection *sel) {
+    tle_catalog *cat = calloc(1, sizeof(tle_catalog));
+    if(!cat) return NULL;
+
+    /* Without a selection, all TLEs in the file are loaded, so the arrays can be
+       allocated once and shrunk to fit afterwards. When there is not that much
+       memory, they grow while reading instead */
+    size_t max_tles = sel ? 0 : max_tles_in_file(in);
+    if(max_tles && reserve_tles(cat, max_tles)) {
+        free(cat->tles);
+        free(cat->info);
+        free(cat->names);
+        free(cat->catalog_numbers);
+        cat->tles = NULL;
+        cat->info = NULL;
+        cat->names = NULL;
+        cat->catalog_numbers = NULL;
+        cat->capacity = 0;
+    }
+    if(read_tles(in, sel, append_tle, cat) ||
+       (cat->count && cat->count < cat->capacity && reserve_tles(cat, cat->count))) {
+        unload_tles(cat);
         return NULL;
     }
+    index_tles(cat);
+    return cat;
 }
 
-loaded_tle *load_tles_from_filename(char *filename) {
+static FILE *open_tles(char *filename, int *compiled) {
     FILE *in;
+    *compiled = 0;
     if(!strcmp("-", filename)) in = stdin;
     else in = fopen(filename, "r");
     if(!in) return NULL;
 
-    loaded_tle *lt = load_tles(in);
+    /* A compiled catalog is recognized by its magic, stdin can only be text
+       since we cannot rewind it */
+    if(in != stdin) {
+        char magic[sizeof TLE_COMPILED_MAGIC];
+        size_t len = fread(magic, 1, sizeof magic, in);
+        if(is_compiled_tle_header(magic, len)) {
+            fclose(in);
+            *compiled = 1;
+            return NULL;
+        }
+        rewind(in);
+    }
+    return in;
+}
+
+int read_tles_from_filename(char *filename, const selection *sel, tle_handler handler, void *arg) {
+    int compiled;
+    FILE *in = open_tles(filename, &compiled);
+    if(compiled) {
+        /* There is nothing to stream, the catalog is only mapped */
+        tle_catalog *cat = load_compiled_tles(filename, sel);
+        if(!cat) return -1;
+        int result = 0;
+        for(size_t l=0; l<cat->count && !result; l++)
+            result = handler(cat->names[l], &cat->tles[l], &cat->info[l], arg);
+        unload_tles(cat);
+        return result;
+    }
+    if(!in) return -1;
+
+    int result = read_tles(in, sel, handler, arg);
     if(in != stdin) fclose(in);
 
-    return lt;
+    return result;
 }
 
-void unload_tles(loaded_tle *lt) {
-    while(lt) {
-        loaded_tle *next = lt->next;
-        free(lt->name);
-        lt = next;
+tle_catalog *load_tles_from_filename(char *filename, const selection *sel) {
+    int compiled;
+    FILE *in = open_tles(filename, &compiled);
+    if(compiled) return load_compiled_tles(filename, sel);
+    if(!in) return NULL;
+
+    tle_catalog *cat = load_tles(in, sel);
+    if(in != stdin) fclose(in);
+
+    return cat;
+}
+
+void unload_tles(tle_catalog *cat) {
+    if(!cat) return;
+    if(cat->map) {
+        /* The names point into the mapping, and so do the other arrays unless
+           a selection was applied */
+        if((char *)cat->tles < (char *)cat->map || (char *)cat->tles >= (char *)cat->map + cat->map_size) {
+            free(cat->tles);
+            free(cat->info);
+            free(cat->catalog_numbers);
+        }
+        munmap(cat->map, cat->map_size);
+    } else {
+        free(cat->tles);
+        free(cat->info);
+        free(cat->catalog_numbers);
     }
+    free(cat->names);
+    arena_free(&cat->strings);
+    free(cat->name_index);
+    free(cat->number_index);
+    free(cat->histories);
+    free(cat->history_entries);
+    free(cat->history_of);
+    free(cat);
 }
 
-loaded_tle *get_tle_by_name(loaded_tle *lt, char *name) {
-    if(!name) 
-        return lt;
-    while(lt) {
-        if(lt->name && !strcmp(name, lt->name)) return lt;
-        lt = lt->next;
+/* FNV-1a */
+static size_t hash_name(const char *name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211ULL;
     }
-    return NULL;
+    return (size_t)hash;
 }
 
-loaded_tle *get_tle_by_index(loaded_tle *lt, size_t index) {
-    for(; index; index--) lt=lt->next;
-    return lt;
+static size_t hash_number(int number) {
+    uint64_t hash = (uint64_t)number * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(hash >> 32);
+}
+
+void index_tles(tle_catalog *cat) {
+    /* Keep the load factor at or below 0.5 */
+    cat->index_size = 16;
+    while(cat->index_size < cat->count * 2) cat->index_size *= 2;
+    cat->name_index = calloc(cat->index_size, sizeof(size_t));
+    cat->number_index = calloc(cat->index_size, sizeof(size_t));
+    if(!cat->name_index || !cat->number_index) {
+        /* Fall back on linear searches */
+        free(cat->name_index);
+        free(cat->number_index);
+        cat->name_index = cat->number_index = NULL;
+        cat->index_size = 0;
+        return;
+    }
+
+    size_t mask = cat->index_size - 1;
+    for(size_t l=0; l<cat->count; l++) {
+        if(cat->names[l]) {
+            size_t slot = hash_name(cat->names[l]) & mask;
+            while(cat->name_index[slot] && strcmp(cat->names[cat->name_index[slot]-1], cat->names[l]))
+                slot = (slot + 1) & mask;
+            if(!cat->name_index[slot]) cat->name_index[slot] = l + 1;
+        }
+
+        int number = cat->catalog_numbers[l];
+        if(number >= 0) {
+            size_t slot = hash_number(number) & mask;
+            while(cat->number_index[slot] &&
+                  cat->catalog_numbers[cat->number_index[slot]-1] != number)
+                slot = (slot + 1) & mask;
+            if(!cat->number_index[slot]) cat->number_index[slot] = l + 1;
+        }
+    }
 }
 
-int count_tles(loaded_tle *lt) {
-    int count = 0;
-    while(lt) {
-        count++;
-        lt = lt->next;
+size_t get_tle_by_name(const tle_catalog *cat, const char *name) {
+    if(!name)
+        return cat->count ? 0 : TLE_NOT_FOUND;
+    if(!cat->name_index) {
+        for(size_t l=0; l<cat->count; l++)
+            if(cat->names[l] && !strcmp(name, cat->names[l])) return l;
+        return TLE_NOT_FOUND;
     }
-    return count;
+    size_t mask = cat->index_size - 1;
+    for(size_t slot = hash_name(name) & mask; cat->name_index[slot]; slot = (slot + 1) & mask)
+        if(!strcmp(cat->names[cat->name_index[slot]-1], name))
+            return cat->name_index[slot] - 1;
+    return TLE_NOT_FOUND;
+}
+
+size_t get_tle_by_catalog_number(const tle_catalog *cat, int number) {
+    if(!cat->number_index) {
+        for(size_t l=0; l<cat->count; l++)
+            if(cat->catalog_numbers[l] == number) return l;
+        return TLE_NOT_FOUND;
+    }
+    size_t mask = cat->index_size - 1;
+    for(size_t slot = hash_number(number) & mask; cat->number_index[slot]; slot = (slot + 1) & mask)
+        if(cat->catalog_numbers[cat->number_index[slot]-1] == number)
+            return cat->number_index[slot] - 1;
+    return TLE_NOT_FOUND;
+}
+
+int tle_catalog_number(const char *object_id) {
+    int number = 0;
+    for(size_t l=0; l<5; l++) {
+        char c = object_id[l];
+        if(c == ' ' && !number) continue;
+        if(c >= '0' && c <= '9') {
+            number = number * 10 + (c - '0');
+        } else if(l == 0 && c >= 'A' && c <= 'Z' && c != 'I' && c != 'O') {
+            /* Alpha-5: A=10 .. Z=33, skipping I and O */
+            number = c - 'A' + 10;
+            if(c > 'I') number--;
+            if(c > 'O') number--;
+        } else {
+            return -1;
+        }
+    }
+    return number;
+}
+
+typedef struct {
+    int catalog_number;
+    size_t first;  /* Index of the first TLE with this catalog number */
+    long epoch;
+    size_t index;
+} history_key;
+
+static int compare_history_keys(const void *a, const void *b) {
+    const history_key *ka = a, *kb = b;
+    if(ka->first != kb->first) return ka->first < kb->first ? -1 : 1;
+    if(ka->epoch != kb->epoch) return ka->epoch < kb->epoch ? -1 : 1;
+    return ka->index < kb->index ? -1 : ka->index > kb->index;
+}
+
+int index_tle_history(tle_catalog *cat) {
+    if(cat->histories) return 0;
+
+    history_key *keys = malloc((cat->count ? cat->count : 1) * sizeof(history_key));
+    cat->history_entries = malloc((cat->count ? cat->count : 1) * sizeof(size_t));
+    cat->history_of = malloc((cat->count ? cat->count : 1) * sizeof(size_t));
+    if(!keys || !cat->history_entries || !cat->history_of) {
+        free(keys);
+        return -1;
+    }
+
+    /* Sorting on the index of the first TLE with the same catalog number (found
+       through the index) keeps the histories in file order */
+    for(size_t l=0; l<cat->count; l++) {
+        keys[l].catalog_number = cat->catalog_numbers[l];
+        keys[l].first = keys[l].catalog_number < 0 ? l : get_tle_by_catalog_number(cat, keys[l].catalog_number);
+        keys[l].epoch = cat->tles[l].epoch;
+        keys[l].index = l;
+    }
+    qsort(keys, cat->count, sizeof(history_key), compare_history_keys);
+
+    cat->nr_histories = 0;
+    for(size_t l=0; l<cat->count; l++)
+        if(!l || keys[l].first != keys[l-1].first) cat->nr_histories++;
+    cat->histories = malloc((cat->nr_histories ? cat->nr_histories : 1) * sizeof(tle_history));
+    if(!cat->histories) {
+        free(keys);
+        return -1;
+    }
+
+    tle_history *history = NULL;
+    for(size_t l=0; l<cat->count; l++) {
+        if(!l || keys[l].first != keys[l-1].first) {
+            history = history ? history + 1 : cat->histories;
+            history->catalog_number = keys[l].catalog_number;
+            history->count = 0;
+            history->entries = &cat->history_entries[l];
+        }
+        cat->history_entries[l] = keys[l].index;
+        cat->history_of[keys[l].index] = history - cat->histories;
+        history->count++;
+    }
+
+    free(keys);
+    return 0;
+}
+
+const tle_history *get_tle_history(const tle_catalog *cat, size_t index) {
+    return &cat->histories[cat->history_of[index]];
+}
+
+static long history_epoch(const tle_catalog *cat, const tle_history *history, size_t l) {
+    return cat->tles[history->entries[l]].epoch;
+}
+
+size_t get_tle_nearest_epoch(const tle_catalog *cat, const tle_history *history, long when,
+                             long *valid_from, long *valid_until) {
+    /* Find the first TLE with an epoch after when, the nearest is either that
+       one or the one before it. On a tie, the earlier one wins */
+    size_t lo = 0, hi = history->count;
+    while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if(history_epoch(cat, history, mid) <= when) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t nearest;
+    if(lo == 0) nearest = 0;
+    else if(lo == history->count) nearest = lo - 1;
+    else if(when - history_epoch(cat, history, lo-1) <= history_epoch(cat, history, lo) - when) nearest = lo - 1;
+    else nearest = lo;
+
+    /* The switch-over between two TLEs is halfway between their epochs */
+    if(valid_from)
+        *valid_from = nearest == 0 ? LONG_MIN :
+            (history_epoch(cat, history, nearest-1) + history_epoch(cat, history, nearest)) / 2 + 1;
+    if(valid_until)
+        *valid_until = nearest == history->count - 1 ? LONG_MAX :
+            (history_epoch(cat, history, nearest) + history_epoch(cat, history, nearest+1)) / 2;
+
+    return history->entries[nearest];
+}
+
+size_t count_tles(const tle_catalog *cat) {
+    return cat->count;
 }
@@ -1,25 +1,101 @@
+#ifndef TLE_LOADER_H
+#define TLE_LOADER_H
+
 #include <stdio.h>
 #include <stddef.h>
 #include "TLE.h"
+#include "selection.h"
+#include "arena.h"
+
+/* Returned by the lookup functions when no matching TLE exists */
+#define TLE_NOT_FOUND ((size_t)-1)
+
+/*
+ * All TLEs in a catalog with the same catalog number, sorted by epoch. The
+ * entries are indexes in the catalog's TLE array.
+ */
+typedef struct {
+    int catalog_number;
+    size_t count;
+    size_t *entries;
+} tle_history;
+
+/*
+ * The loaded TLEs are stored in contiguous arrays, tles[n], info[n], names[n] and
+ * catalog_numbers[n] belong to the n-th TLE in the file. Only tles is used when
+ * propagating, the other arrays are kept apart so that scanning all satellites
+ * does not pull them into the cache. The hash indexes make lookups by name and
+ * by catalog number O(1); when the file contains the same name or catalog number
+ * more than once, the lookups return the first one.
+ */
+typedef struct {
+    size_t count;
+    size_t capacity;
+    TLE *tles;
+    TLEInfo *info;
+    char **names;          /* Entries may be NULL */
+    int *catalog_numbers;  /* -1 when the object ID is not valid */
+    arena strings;         /* Holds the names, unless they point into map */
+
+    size_t index_size;     /* Number of slots in the indexes, a power of 2 */
+    size_t *name_index;    /* Slots contain a TLE index + 1, or 0 when empty */
+    size_t *number_index;
+
+    size_t nr_histories;   /* Only set after index_tle_history */
+    tle_history *histories;
+    size_t *history_entries;
+    size_t *history_of;    /* For each TLE, the index of its history */
+
+    void *map;             /* Set when tles points into a compiled catalog */
+    size_t map_size;
+} tle_catalog;
+
+/* Only the TLEs matching sel are loaded, or all TLEs when sel is NULL. TLEs that
+   are not selected are skipped before they are parsed. When no TLEs are found,
+   an empty catalog is returned, NULL is only returned on errors */
+tle_catalog *load_tles(FILE *in, const selection *sel);
+
+tle_catalog *load_tles_from_filename(char *filename, const selection *sel);
+
+/* Called for every TLE as soon as it has been read. name may be NULL. The name, tle
+   and info are only valid during the call. Returning non-zero stops reading */
+typedef int (*tle_handler)(const char *name, TLE *tle, TLEInfo *info, void *arg);
+
+/* Reads the TLEs one by one without loading them, so memory use is constant. Returns
+   0 on success, -1 on errors or the non-zero value returned by handler */
+int read_tles(FILE *in, const selection *sel, tle_handler handler, void *arg);
 
-typedef struct loaded_tle_t {
-    char *name; /* May be NULL */
-    TLE tle;
-    struct loaded_tle_t *next;
-} loaded_tle;
+int read_tles_from_filename(char *filename, const selection *sel, tle_handler handler, void *arg);
 
-loaded_tle *load_tles(FILE *in);
+/* Builds the name and catalog number indexes, used after filling names and
+   catalog_numbers */
+void index_tles(tle_catalog *cat);
 
-loaded_tle *load_tles_from_filename(char *filename);
+/* Returns the first TLE when name is NULL */
+size_t get_tle_by_name(const tle_catalog *cat, const char *name);
 
-loaded_tle *get_tle_by_name(loaded_tle *lt, char *name);
+size_t get_tle_by_catalog_number(const tle_catalog *cat, int number);
 
-loaded_tle *get_tle_by_index(loaded_tle *lt, size_t index);
+/* Returns the catalog number in the given object ID, which may be in the
+   alpha-5 format, or -1 if it is not valid */
+int tle_catalog_number(const char *object_id);
 
-void unload_tles(loaded_tle *lt);
+/* Groups the TLEs by catalog number into histories, ordered by the first
+   appearance of each catalog number in the file. Returns 0 on success */
+int index_tle_history(tle_catalog *cat);
 
-int count_tles(loaded_tle *lt);
+/* Returns the history that the TLE with the given index belongs to */
+const tle_history *get_tle_history(const tle_catalog *cat, size_t index);
 
+/* Returns the index of the TLE in history with the epoch closest to when,
+   in milliseconds since 1970. If valid_from and valid_until are not NULL, they
+   are set to the (inclusive) range of times for which the same TLE would be
+   returned, so that callers only need to search again when leaving it */
+size_t get_tle_nearest_epoch(const tle_catalog *cat, const tle_history *history, long when,
+                             long *valid_from, long *valid_until);
 
+void unload_tles(tle_catalog *cat);
 
+size_t count_tles(const tle_catalog *cat);
 
+#endif
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <sysexits.h>
+#include <string.h>
+#include <errno.h>
+#include "tle_loader.h"
+#include "tle_compiled.h"
+#include "selection.h"
+#include "version.h"
+
+static char *executable;
+
+static void usage(void) {
+    printf("Usage: %s [OPTION...] [<TLE_FILE>]\n", executable);
+    printf("\n");
+    printf("Compiles the TLEs in TLE_FILE into a binary catalog, that\n");
+    printf("can be used in place of the TLE-file by the other tools and\n");
+    printf("is loaded without parsing or initializing the TLEs again.\n");
+    printf("The catalog can only be used by tools built from the same\n");
+    printf("version on the same platform.\n");
+    printf("\n");
+    printf("TLE_FILE is the name of the TLE-file. Use - to read from\n");
+    printf("stdin. When not supplied, $ORBIT_TOOLS_TLE is consulted for\n");
+    printf("the filename\n");
+    printf("\n");
+    printf("Options are:\n");
+    printf("-h,--help        : show this help and exit\n");
+    printf("-V,--version     : show version and exit\n");
+    printf("-o,--output=FILE : write the catalog to FILE. This option is\n");
+    printf("                   required.\n");
+    printf("-S,--select=SEL  : only compile the selected satellites. SEL is\n");
+    printf("                   a comma-separated list of names, patterns\n");
+    printf("                   like FLOCK*, catalog numbers and ranges of\n");
+    printf("                   catalog numbers like 40000-40100\n");
+}
+
+static void usage_error(char *msg) {
+    fprintf(stderr, "Error: %s\n\n%s --help for help\n", msg, executable);
+    exit(EX_USAGE);
+}
+
+int main(int argc, char *argv[]) {
+    executable = argv[0];
+
+    struct option longopts[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'V' },
+        { "output", required_argument, NULL, 'o' },
+        { "select", required_argument, NULL, 'S' },
+        { NULL }
+    };
+
+    opterr = 0;
+    int c;
+    char *output = NULL;
+    selection *sel = NULL;
+
+    while((c = getopt_long(argc, argv, "hVo:S:", longopts, NULL)) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                exit(0);
+            case 'V':
+                printf("%s\n", VERSION);
+                exit(0);
+            case 'o':
+                free(output);
+                output = strdup(optarg);
+                break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
+            default:
+                usage_error("Invalid option");
+                break;
+        }
+    }
+
+    char *file = NULL;
+    if(optind == argc-1) file=argv[argc-1];
+    else if(optind == argc && getenv("ORBIT_TOOLS_TLE")) file = getenv("ORBIT_TOOLS_TLE");
+    else usage_error("either supply a filename or set $ORBIT_TOOLS_TLE");
+
+    if(!output) usage_error("Supply an output file with --output");
+
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to load file");
+    if(!cat->count) usage_error("No satellites found");
+
+    FILE *out = fopen(output, "w");
+    if(!out) {
+        fprintf(stderr, "Failed to open %s: %s\n", output, strerror(errno));
+        exit(EX_IOERR);
+    }
+
+    if(write_compiled_tles(out, cat) | fclose(out)) {
+        fprintf(stderr, "Failed to write %s: %s\n", output, strerror(errno));
+        remove(output);
+        exit(EX_IOERR);
+    }
+
+    unload_tles(cat);
+    free_selection(sel);
+    free(output);
+}
@@ -456,7 +456,8 @@ int main(int argc, char *argv[]) {
         
         /* Use SGP4 to calculate the longitude when reaching this latitude */
         TLE tle;
-        fromTLEData(&tle, &td);
+        TLEInfo info;
+        fromTLEData(&tle, &info, &td);
         observer obs = { 0, 0, 0 };
         observation result;
         observe(&obs, &result, &tle, target_time);
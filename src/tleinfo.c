@@ -5,12 +5,15 @@
 #include <string.h>
 #include <time.h>
 #include "tle_loader.h"
+#include "selection.h"
 #include "output.h"
 #include "util.h"
 #include "version.h"
 
 #define DEFAULT_SELECTOR "nie12BIRxpamN"
 
+#define OPT_STREAM (256)
+
 static char *executable;
 
 void usage(void) {
@@ -28,8 +31,18 @@ void usage(void) {
     printf("                            which to show information. The\n");
     printf("                            default is to show information about\n");
     printf("                            all satellites in the file\n");
-    printf("-f,--format=FORMAT        : Set the format to either `rows` or\n");
-    printf("                            `cols`. The default is `rows`.\n");
+    printf("-S,--select=SELECTION     : only show the selected satellites.\n");
+    printf("                            SELECTION is a comma-separated list\n");
+    printf("                            of names, patterns like FLOCK*,\n");
+    printf("                            catalog numbers and ranges of catalog\n");
+    printf("                            numbers like 40000-40100\n");
+    printf("-f,--format=FORMAT        : Set the format to either `rows`,\n");
+    printf("                            `cols`, `csv`, `ndjson`, `binary` or\n");
+    printf("                            `npy`. The default is `rows`.\n");
+    printf("   --stream               : Show each TLE as soon as it has been\n");
+    printf("                            read, instead of loading the whole file\n");
+    printf("                            first. Memory use does not depend on\n");
+    printf("                            the size of the file.\n");
     printf("-H,--headers              : When the format is cols, first print\n");
     printf("                            a row with headers.\n");
     printf("-F,--fields=FIELDS        : Specifies the fields to include in the\n");
@@ -76,23 +89,38 @@ static field fields[] = {
     { NULL }
 };
 
-static void print(int x, const char *name, const TLE *tle, const char *selector, int rows) {
+static void print(int x, const char *name, const TLE *tle, const TLEInfo *info, output_plan *plan) {
     field_value values[sizeof fields / sizeof fields[0] - 1];
     values[0].value.string_value = name ? name : "<no name>";
-    values[1].value.string_value = tle->objectID;
+    values[1].value.string_value = info->objectID;
     values[2].value.time_value = tle->epoch/1000;
     values[3].value.time_value = tle->epoch/1000;
-    values[4].value.double_value = tle->ndot;
-    values[5].value.double_value = tle->nddot;
-    values[6].value.double_value = tle->bstar;
-    values[7].value.double_value = tle->incDeg;
-    values[8].value.double_value = tle->raanDeg;
-    values[9].value.double_value = tle->ecc;
-    values[10].value.double_value = tle->argpDeg;
-    values[11].value.double_value = tle->maDeg;
-    values[12].value.double_value = tle->n;
-    values[13].value.int_value = tle->revnum;
-    render(x, fields, values, selector, rows);
+    values[4].value.double_value = info->ndot;
+    values[5].value.double_value = info->nddot;
+    values[6].value.double_value = info->bstar;
+    values[7].value.double_value = info->incDeg;
+    values[8].value.double_value = info->raanDeg;
+    values[9].value.double_value = info->ecc;
+    values[10].value.double_value = info->argpDeg;
+    values[11].value.double_value = info->maDeg;
+    values[12].value.double_value = info->n;
+    values[13].value.int_value = info->revnum;
+    render(x, plan, values);
+}
+
+typedef struct {
+    const char *sat_name;
+    output_plan *plan;
+    int count;
+} stream_state;
+
+static int print_streamed(const char *name, TLE *tle, TLEInfo *info, void *arg) {
+    stream_state *state = arg;
+    if(state->sat_name && (!name || strcmp(name, state->sat_name)))
+        return 0;
+    print(state->count++, name, tle, info, state->plan);
+    /* With a satellite name, only the first match is shown */
+    return state->sat_name ? 1 : 0;
 }
 
 int main(int argc, char *argv[]) {
@@ -102,7 +130,9 @@ int main(int argc, char *argv[]) {
         { "help", no_argument, NULL, 'h' },
         { "version", no_argument, NULL, 'V' },
         { "satellite-name", required_argument, NULL, 'n' },
+        { "select", required_argument, NULL, 'S' },
         { "format", required_argument, NULL, 'f' },
+        { "stream", no_argument, NULL, OPT_STREAM },
         { "headers", no_argument, NULL, 'H' },
         { "fields", required_argument, NULL, 'F' },
         { NULL }
@@ -111,11 +141,13 @@ int main(int argc, char *argv[]) {
     opterr = 0;
     int c;
     char *sat_name = NULL;
+    selection *sel = NULL;
     int headers = 0;
-    int rows = 1;
+    output_format fmt = output_rows;
+    int stream = 0;
     char *selector = NULL;
     
-    while((c = getopt_long(argc, argv, "hVn:f:HF:", longopts, NULL)) != -1) {
+    while((c = getopt_long(argc, argv, "hVn:S:f:HF:", longopts, NULL)) != -1) {
         switch(c) {
             case 'h':
                 usage();
@@ -127,13 +159,20 @@ int main(int argc, char *argv[]) {
                 free(sat_name);
                 sat_name = strdup(optarg);
                 break;
+            case 'S':
+                free_selection(sel);
+                if(!(sel = parse_selection(optarg)))
+                    usage_error("Invalid selection");
+                break;
             case 'H':
                 headers = 1;
                 break;
+            case OPT_STREAM:
+                stream = 1;
+                break;
             case 'f':
-                if(string_starts_with("cols", optarg)) rows = 0;
-                else if(string_starts_with("rows", optarg)) rows = 1;
-                else usage_error("Invalid format");
+                if(parse_output_format(optarg, &fmt))
+                    usage_error("Invalid format");
                 break;
             case 'F':
                 if(check_selector(fields, optarg))
@@ -153,30 +192,40 @@ int main(int argc, char *argv[]) {
     else usage_error("either supply a filename or set $ORBIT_TOOLS_TLE");
 
     if(!selector) selector = DEFAULT_SELECTOR;
+    output_plan *plan = plan_output(fields, selector, fmt);
+
+    if(stream) {
+        if(fmt == output_cols && headers) render_headers(plan);
+        stream_state state = { sat_name, plan, 0 };
+        if(read_tles_from_filename(file, sel, print_streamed, &state) < 0)
+            usage_error("Failed to load file");
+        if(!state.count) usage_error(sat_name ? "Satellite not found" : "No satellites found");
+        close_output(plan);
+        exit(0);
+    }
 
-    loaded_tle *lt = load_tles_from_filename(file);
-    if(!lt) usage_error("Failed to load file");
+    tle_catalog *cat = load_tles_from_filename(file, sel);
+    if(!cat) usage_error("Failed to load file");
+    if(!cat->count) usage_error("No satellites found");
 
-    if(!rows && headers) render_headers(fields, selector);
+    if(fmt == output_cols && headers) render_headers(plan);
 
+    plan->expected_rows = sat_name ? 1 : cat->count;
     if(sat_name) {
-        loaded_tle *target = get_tle_by_name(lt, sat_name);
-        if(!target) {
-            unload_tles(lt);
+        size_t target = get_tle_by_name(cat, sat_name);
+        if(target == TLE_NOT_FOUND) {
+            unload_tles(cat);
             usage_error("Satellite not found");
         }
-        print(0, target->name, &target->tle, selector, rows);
+        print(0, cat->names[target], &cat->tles[target], &cat->info[target], plan);
     } else {
-        int l=0;
-        for(loaded_tle *target = lt; target; target=target->next) {
-            print(l++, target->name, &target->tle, selector, rows);
+        for(size_t l=0; l<cat->count; l++) {
+            print(l, cat->names[l], &cat->tles[l], &cat->info[l], plan);
         }
     }
 
-    unload_tles(lt);
-
-    
-
-    
-    
+    unload_tles(cat);
+    close_output(plan);
+    free_selection(sel);
+    free(sat_name);
 }
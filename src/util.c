@@ -20,25 +20,25 @@ double rad_to_deg(double a_rad) {
     return a_rad * 180.0 / (double)M_PI;
 }
 
-double vec3_len(double vec[3]) {
+double vec3_len(const double vec[3]) {
     return sqrt(vec[0] * vec[0] + vec[1] * vec[1] + vec[2] * vec[2]);
 }
 
-void vec3_scalar_mult(double original[3], double scalar, double result[3]) {
+void vec3_scalar_mult(const double original[3], double scalar, double result[3]) {
     for(size_t l=0; l<3; l++)
         result[l] = original[l] * scalar;
 }
 
-void vec3_norm(double original[3], double result[3]) {
+void vec3_norm(const double original[3], double result[3]) {
     double len = vec3_len(original);
     vec3_scalar_mult(original, 1.0/len, result);
 }
 
-double dot_product(double a[3], double b[3]) {
+double dot_product(const double a[3], const double b[3]) {
     return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
 }
 
-void cross_product(double a[3], double b[3], double result[3]) {
+void cross_product(const double a[3], const double b[3], double result[3]) {
     result[0] = a[1]*b[2] - a[2]*b[1];
     result[1] = a[2]*b[0] - a[0]*b[2];
     result[2] = a[0]*b[1] - a[1]*b[0];
@@ -61,6 +61,11 @@ void vec3_add_to(double dst[3], const double addend[3]) {
         dst[l] += addend[l];
 }
 
+void vec3_sub(const double a[3], const double b[3], double result[3]) {
+    for(size_t l=0; l<3; l++)
+        result[l] = a[l] - b[l];
+}
+
 static double get_earth_rotation(double time) {
     double delta_t = time - J2000;
     return WGS84_OMEGA * delta_t + deg_to_rad(EARTH_ANGLE_AT_J2000);
@@ -82,3 +87,22 @@ void eci_to_ecef(double eci[3], double time, double ecef[3]) {
     ecef[1] = eci[0] * sin(a) + eci[1] * cos(a);
     ecef[2] = eci[2];
 }
+
+void earth_rotation(double time, double *cos_a, double *sin_a) {
+    double a = get_earth_rotation(time);
+    *cos_a = cos(a);
+    *sin_a = sin(a);
+}
+
+void ecef_to_eci_rotated(const double ecef[3], double cos_a, double sin_a, double eci[3]) {
+    eci[0] = ecef[0] * cos_a - ecef[1] * sin_a;
+    eci[1] = ecef[0] * sin_a + ecef[1] * cos_a;
+    eci[2] = ecef[2];
+}
+
+void eci_to_ecef_rotated(const double eci[3], double cos_a, double sin_a, double ecef[3]) {
+    /* Rotates by minus the angle */
+    ecef[0] = eci[0] * cos_a + eci[1] * sin_a;
+    ecef[1] = -eci[0] * sin_a + eci[1] * cos_a;
+    ecef[2] = eci[2];
+}
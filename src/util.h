@@ -7,15 +7,15 @@ double deg_to_rad(double a_deg);
 
 double rad_to_deg(double a_rad);
 
-double vec3_len(double vec[3]);
+double vec3_len(const double vec[3]);
 
-void vec3_scalar_mult(double original[3], double scalar, double result[3]);
+void vec3_scalar_mult(const double original[3], double scalar, double result[3]);
 
-void vec3_norm(double original[3], double result[3]);
+void vec3_norm(const double original[3], double result[3]);
 
-double dot_product(double a[3], double b[3]);
+double dot_product(const double a[3], const double b[3]);
 
-void cross_product(double a[3], double b[3], double result[3]);
+void cross_product(const double a[3], const double b[3], double result[3]);
 
 /*
  * Convert the given latitude and longitude in degrees to a point 
@@ -27,8 +27,22 @@ void vec3_copy(double dst[3], const double src[3]);
 
 void vec3_add_to(double dst[3], const double addend[3]);
 
+/* result = a - b */
+void vec3_sub(const double a[3], const double b[3], double result[3]);
+
 void ecef_to_eci(double ecef[3], double time, double eci[3]);
 
 void eci_to_ecef(double eci[3], double time, double ecef[3]);
 
+/*
+ * Calculates the cosine and sine of the earth rotation at the given time, so
+ * that many vectors can be converted between ECEF and ECI at the same time
+ * with ecef_to_eci_rotated and eci_to_ecef_rotated
+ */
+void earth_rotation(double time, double *cos_a, double *sin_a);
+
+void ecef_to_eci_rotated(const double ecef[3], double cos_a, double sin_a, double eci[3]);
+
+void eci_to_ecef_rotated(const double eci[3], double cos_a, double sin_a, double ecef[3]);
+
 #endif
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "workers.h"
+#include "util.h"
+
+void run_workers(void *workers, size_t worker_size, int nr_workers, void *(*work)(void *)) {
+    char *worker = workers;
+    pthread_t *threads = nr_workers > 1 ? malloc((nr_workers - 1) * sizeof(pthread_t)) : NULL;
+    char *started = nr_workers > 1 ? calloc(nr_workers - 1, 1) : NULL;
+    for(int l=1; l<nr_workers && threads && started; l++)
+        started[l-1] = !pthread_create(&threads[l-1], NULL, work, worker + l * worker_size);
+    work(worker);
+    for(int l=1; l<nr_workers; l++) {
+        if(threads && started && started[l-1]) pthread_join(threads[l-1], NULL);
+        else work(worker + l * worker_size);
+    }
+    free(threads);
+    free(started);
+}
+
+void propagate_tles(const propagation *p, size_t first_tle, size_t last_tle,
+                    size_t first_moment, size_t last_moment) {
+    size_t stride = p->velocities ? 6 : 3;
+    for(size_t t=first_tle; t<last_tle; t++) {
+        for(size_t m=first_moment; m<last_moment; m++) {
+            double r[3], v[3];
+            double *state = &p->states[(m * p->nr_tles + t) * stride];
+            getRVForDate(&p->tles[t], p->times[m], r, v);
+            if(p->tles[t].sgp4Error) {
+                p->failed[t] = 1;
+                for(size_t l=0; l<stride; l++) state[l] = NAN;
+            } else if(p->rotations) {
+                eci_to_ecef_rotated(r, p->rotations[2*m], p->rotations[2*m+1], state);
+            } else {
+                vec3_copy(state, r);
+                if(p->velocities) vec3_copy(state + 3, v);
+            }
+        }
+    }
+}
+
+void report_sgp4_failures(const char *failed, size_t nr_tles, const char *consequence) {
+    size_t nr_failed = 0;
+    for(size_t t=0; t<nr_tles; t++) nr_failed += failed[t];
+    if(nr_failed)
+        fprintf(stderr, "Warning: SGP4 failed for %zu satellite%s, %s\n", nr_failed,
+                nr_failed == 1 ? "" : "s", consequence);
+}
@@ -0,0 +1,45 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stddef.h>
+#include "TLE.h"
+
+/*
+ * The tools that use multiple threads divide each step of their work over a
+ * number of workers, and run them all to completion before the next step.
+ */
+
+/* Calls work for each of the nr_workers elements of workers, which are
+   worker_size bytes each, on a thread of its own, and returns when all are
+   done. The first worker runs on the calling thread, as do workers whose
+   thread could not be started */
+void run_workers(void *workers, size_t worker_size, int nr_workers, void *(*work)(void *));
+
+/*
+ * The states of satellites at the moments of a batch. SGP4 stores
+ * intermediate results in the TLE, so each TLE may only be propagated by one
+ * thread at a time: the satellites are divided over the workers, rather than
+ * the moments. At moments for which SGP4 fails, the state is NAN.
+ */
+typedef struct {
+    TLE *tles;
+    size_t nr_tles;
+    char *failed;               /* For each TLE, set when SGP4 failed at some moment */
+    const long *times;          /* For each moment, in milliseconds since 1970 */
+    const double *rotations;    /* When set, the cosine and sine of the earth rotation at each
+                                   moment, and the positions are in ECEF instead of ECI */
+    int velocities;             /* When set, each position in ECI is followed by the velocity */
+    double *states;             /* states[(moment * nr_tles + tle) * (velocities ? 6 : 3)] */
+} propagation;
+
+/* Calculates the states of the TLEs from first_tle up to last_tle, at the
+   moments from first_moment up to last_moment */
+void propagate_tles(const propagation *p, size_t first_tle, size_t last_tle,
+                    size_t first_moment, size_t last_moment);
+
+/* When SGP4 failed for any of the nr_tles satellites, warns on stderr how
+   many, followed by what that means for them, which is phrased to follow
+   "satellites, " */
+void report_sgp4_failures(const char *failed, size_t nr_tles, const char *consequence);
+
+#endif